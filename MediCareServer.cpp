@@ -1,745 +1,5065 @@
 #include "MediCareServer.h"
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <climits>
+#include <ctime>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cctype>
+#include <cmath>
 #include <cstring>
 #include <thread>
 #include <regex>
 #include <fstream>
+#include <random>
+#include <zlib.h>
+#include <brotli/encode.h>
 
 namespace MediCare {
 
+// HtmlTemplate implementation
+std::shared_ptr<const HtmlTemplate> HtmlTemplate::compile(std::string source, std::string& error) {
+    auto compiled = std::make_shared<HtmlTemplate>();
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t open = source.find("{{", pos);
+        size_t literalEnd = open == std::string::npos ? source.size() : open;
+        if (literalEnd > pos) {
+            compiled->segments.push_back({static_cast<uint32_t>(pos), static_cast<uint32_t>(literalEnd - pos), false, false});
+            compiled->literalBytes += literalEnd - pos;
+        }
+        if (open == std::string::npos) break;
+
+        bool raw = source.compare(open, 3, "{{{") == 0;
+        size_t nameStart = open + (raw ? 3 : 2);
+        size_t close = source.find(raw ? "}}}" : "}}", nameStart);
+        if (close == std::string::npos) {
+            error = "unterminated placeholder at offset " + std::to_string(open);
+            return nullptr;
+        }
+        size_t nameEnd = close;
+        while (nameStart < nameEnd && std::isspace(static_cast<unsigned char>(source[nameStart]))) ++nameStart;
+        while (nameEnd > nameStart && std::isspace(static_cast<unsigned char>(source[nameEnd - 1]))) --nameEnd;
+        if (nameStart == nameEnd) {
+            error = "empty placeholder at offset " + std::to_string(open);
+            return nullptr;
+        }
+        compiled->segments.push_back({static_cast<uint32_t>(nameStart), static_cast<uint32_t>(nameEnd - nameStart), true, raw});
+        pos = close + (raw ? 3 : 2);
+    }
+    compiled->source = std::move(source);
+    return compiled;
+}
+
+void HtmlTemplate::appendEscaped(std::string& out, std::string_view text) {
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char* entity = nullptr;
+        switch (text[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&#39;"; break;
+            default: continue;
+        }
+        out.append(text.data() + start, i - start);
+        out.append(entity);
+        start = i + 1;
+    }
+    out.append(text.data() + start, text.size() - start);
+}
+
+void HtmlTemplate::render(std::string& out, std::initializer_list<TemplateArg> args) const {
+    out.reserve(out.size() + literalBytes + 64 * args.size());
+    for (const auto& segment : segments) {
+        std::string_view text(source.data() + segment.offset, segment.length);
+        if (!segment.placeholder) {
+            out.append(text);
+            continue;
+        }
+        for (const auto& arg : args) {
+            if (arg.name != text) continue;
+            if (arg.kind == TemplateArg::Kind::Text) {
+                if (segment.raw) out.append(arg.text);
+                else appendEscaped(out, arg.text);
+            } else {
+                char number[32];
+                int length = arg.kind == TemplateArg::Kind::Integer
+                    ? snprintf(number, sizeof(number), "%lld", arg.integer)
+                    : snprintf(number, sizeof(number), "%g", arg.decimal);
+                out.append(number, static_cast<size_t>(length));
+            }
+            break;
+        }
+    }
+}
+
+// TemplateLibrary implementation
+size_t TemplateLibrary::load(const std::string& directory, std::string& error) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        error = directory + ": " + strerror(errno);
+        return 0;
+    }
+    size_t loaded = 0;
+    while (dirent* entry = readdir(dir)) {
+        std::string fileName = entry->d_name;
+        const std::string extension = ".html";
+        if (fileName.size() <= extension.size() ||
+            fileName.compare(fileName.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+        std::ifstream file(directory + "/" + fileName, std::ios::binary);
+        std::ostringstream buffer;
+        buffer << file.rdbuf();
+
+        std::string problem;
+        auto compiled = HtmlTemplate::compile(buffer.str(), problem);
+        if (!compiled) {
+            error += (error.empty() ? "" : "; ") + fileName + ": " + problem;
+            continue;
+        }
+        templates[fileName.substr(0, fileName.size() - extension.size())] = compiled;
+        ++loaded;
+    }
+    closedir(dir);
+    return loaded;
+}
+
+const HtmlTemplate& TemplateLibrary::get(const std::string& name) const {
+    static const HtmlTemplate empty;
+    auto it = templates.find(name);
+    return it == templates.end() ? empty : *it->second;
+}
+
 // Doct class
-bool Doctor::hasSpecialization(const std::string& spec) const {
+bool Doctor::hasSpecialization(std::string_view spec) const {
     for (const auto& s : specializations) {
-        if (s.find(spec) != std::string::npos || spec.find(s) != std::string::npos) {
+        if (s.find(spec) != std::string::npos || spec.find(s) != std::string_view::npos) {
             return true;
         }
     }
-    return specialty.find(spec) != std::string::npos || spec.find(specialty) != std::string::npos;
+    return specialty.find(spec) != std::string::npos || spec.find(specialty) != std::string_view::npos;
+}
+
+void Doctor::renderHtmlCard(const TemplateLibrary& templates, std::string& out, bool isRecommended,
+                            const std::vector<std::pair<std::string, std::string>>& nextSlots) const {
+    std::string slots;
+    if (!nextSlots.empty()) {
+        std::string buttons;
+        for (const auto& slot : nextSlots) {
+            templates.get("slot_button").render(buttons, {{"doctorId", id}, {"date", slot.first}, {"time", slot.second}});
+        }
+        templates.get("doctor_slots").render(slots, {{"buttons", buttons}});
+    }
+
+    templates.get("doctor_card").render(out, {
+        {"cardStyle", isRecommended ? " style='border: 3px solid #2563eb; background: linear-gradient(135deg, #eff6ff, #f0f9ff);'" : ""},
+        {"badge", isRecommended ? "  RECOMMENDED" : ""},
+        {"imageUrl", imageUrl},
+        {"name", name},
+        {"specialty", specialty},
+        {"rating", rating},
+        {"reviewCount", reviewCount},
+        {"experience", experience},
+        {"bio", bio},
+        {"slots", slots},
+        {"fee", consultationFee / 100},
+        {"doctorId", id},
+    });
+}
+
+// SpecialtyIndex implementation
+static std::string toLowerCopy(std::string_view text) {
+    std::string lowered(text);
+    for (auto& c : lowered) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return lowered;
+}
+
+// Term ids whose term contains key or is contained in it
+static void matchTerms(const std::vector<std::string>& terms, const std::string& key, std::vector<uint32_t>& matches) {
+    if (key.empty()) return;
+    for (uint32_t id = 0; id < terms.size(); ++id) {
+        if (terms[id].find(key) != std::string::npos || key.find(terms[id]) != std::string::npos) {
+            matches.push_back(id);
+        }
+    }
+}
+
+void SpecialtyIndex::build(const std::vector<std::shared_ptr<Doctor>>& doctors) {
+    ranked = doctors;
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::shared_ptr<Doctor>& a, const std::shared_ptr<Doctor>& b) {
+        if (a->getRating() != b->getRating()) return a->getRating() > b->getRating();
+        return a->getReviewCount() > b->getReviewCount();
+    });
+
+    rankById.clear();
+    terms.clear();
+    postings.clear();
+    std::unordered_map<std::string, uint32_t> termIds;
+    for (uint32_t rank = 0; rank < ranked.size(); ++rank) {
+        const Doctor& doctor = *ranked[rank];
+        rankById[doctor.getId()] = rank;
+
+        auto addTerm = [&](const std::string& name) {
+            std::string term = toLowerCopy(name);
+            auto inserted = termIds.emplace(term, static_cast<uint32_t>(terms.size()));
+            if (inserted.second) {
+                terms.push_back(std::move(term));
+                postings.emplace_back();
+            }
+            auto& list = postings[inserted.first->second];
+            if (list.empty() || list.back() != rank) list.push_back(rank); // ranks arrive in order
+        };
+        for (const auto& name : doctor.getSpecializations()) addTerm(name);
+        addTerm(doctor.getSpecialty());
+    }
+
+    // Precompute matches for the vocabulary itself, which is what analyses usually ask for.
+    // Arbitrary queries are not memoized so clients cannot grow this map.
+    termMatches.clear();
+    for (const auto& term : terms) {
+        std::vector<uint32_t> matches;
+        matchTerms(terms, term, matches);
+        termMatches.emplace(term, std::move(matches));
+    }
+}
+
+std::shared_ptr<Doctor> SpecialtyIndex::findById(int id) const {
+    auto it = rankById.find(id);
+    return it == rankById.end() ? nullptr : ranked[it->second];
+}
+
+const std::vector<uint32_t>& SpecialtyIndex::resolve(const std::string& query, std::vector<uint32_t>& scratch) const {
+    std::string key = toLowerCopy(query);
+    auto it = termMatches.find(key);
+    if (it != termMatches.end()) return it->second;
+
+    // Scan the interned vocabulary, not every doctor
+    scratch.clear();
+    matchTerms(terms, key, scratch);
+    return scratch;
+}
+
+std::vector<std::shared_ptr<Doctor>> SpecialtyIndex::lookup(const std::string& specialty) const {
+    return lookupAny({specialty}, ranked.size());
+}
+
+std::vector<std::shared_ptr<Doctor>> SpecialtyIndex::lookupAny(const std::vector<std::string>& specialties, size_t limit) const {
+    std::vector<uint64_t> seen((ranked.size() + 63) / 64, 0);
+    std::vector<uint8_t> matchCount(ranked.size(), 0);
+    std::vector<uint32_t> hits;
+    std::vector<uint32_t> scratch;
+
+    for (const auto& specialty : specialties) {
+        // A doctor counts once per requested specialty, however many of its terms matched
+        std::vector<uint64_t> matchedThisQuery(seen.size(), 0);
+        for (uint32_t termId : resolve(specialty, scratch)) {
+            for (uint32_t rank : postings[termId]) {
+                uint64_t bit = uint64_t(1) << (rank % 64);
+                if (matchedThisQuery[rank / 64] & bit) continue;
+                matchedThisQuery[rank / 64] |= bit;
+                if (!(seen[rank / 64] & bit)) {
+                    seen[rank / 64] |= bit;
+                    hits.push_back(rank);
+                }
+                if (matchCount[rank] < 255) matchCount[rank]++;
+            }
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [&](uint32_t a, uint32_t b) {
+        if (matchCount[a] != matchCount[b]) return matchCount[a] > matchCount[b];
+        return a < b;
+    });
+    if (hits.size() > limit) hits.resize(limit);
+
+    std::vector<std::shared_ptr<Doctor>> result;
+    result.reserve(hits.size());
+    for (uint32_t rank : hits) result.push_back(ranked[rank]);
+    return result;
+}
+
+// MarkdownRenderer implementation
+void MarkdownRenderer::render(std::string_view markdown, std::string& out) {
+    MarkdownRenderer renderer;
+    renderer.feed(markdown, out);
+    renderer.finish(out);
+}
+
+void MarkdownRenderer::feed(std::string_view text, std::string& out) {
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        if (newline == std::string_view::npos) {
+            pendingLine.append(text);
+            return;
+        }
+        if (pendingLine.empty()) {
+            renderLine(text.substr(0, newline), out);
+        } else {
+            pendingLine.append(text.substr(0, newline));
+            renderLine(pendingLine, out);
+            pendingLine.clear();
+        }
+        text.remove_prefix(newline + 1);
+    }
+}
+
+void MarkdownRenderer::finish(std::string& out) {
+    if (!pendingLine.empty()) {
+        renderLine(pendingLine, out);
+        pendingLine.clear();
+    }
+    closeParagraph(out);
+    closeListsDeeperThan(0, out);
+}
+
+void MarkdownRenderer::closeParagraph(std::string& out) {
+    if (inParagraph) {
+        out += "</p>\n";
+        inParagraph = false;
+    }
+}
+
+// Closes every open list whose indent is >= indent (so 0 closes them all)
+void MarkdownRenderer::closeListsDeeperThan(size_t indent, std::string& out) {
+    while (!lists.empty() && lists.back().indent >= indent) {
+        out += lists.back().ordered ? "</li></ol>\n" : "</li></ul>\n";
+        lists.pop_back();
+    }
+}
+
+void MarkdownRenderer::renderLine(std::string_view line, std::string& out) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    size_t indent = 0;
+    while (indent < line.size() && (line[indent] == ' ' || line[indent] == '\t')) ++indent;
+    std::string_view content = line.substr(indent);
+
+    if (content.empty()) {
+        closeParagraph(out);
+        return;
+    }
+
+    // Headings: 1-6 '#' followed by a space
+    size_t hashes = 0;
+    while (hashes < content.size() && content[hashes] == '#') ++hashes;
+    if (hashes >= 1 && hashes <= 6 && hashes < content.size() && content[hashes] == ' ') {
+        closeParagraph(out);
+        closeListsDeeperThan(0, out);
+        char level = static_cast<char>('0' + std::min<size_t>(hashes + 2, 6));
+        out += "<h"; out += level; out += " style='margin:14px 0 6px;'>";
+        renderInline(content.substr(hashes + 1), out);
+        out += "</h"; out += level; out += ">\n";
+        return;
+    }
+
+    // List items: "* ", "- ", "+ " or "12. "
+    bool ordered = false;
+    size_t markerLength = 0;
+    if (content.size() >= 2 && (content[0] == '*' || content[0] == '-' || content[0] == '+') && content[1] == ' ') {
+        markerLength = 2;
+    } else {
+        size_t digits = 0;
+        while (digits < content.size() && std::isdigit(static_cast<unsigned char>(content[digits]))) ++digits;
+        if (digits > 0 && digits + 1 < content.size() && content[digits] == '.' && content[digits + 1] == ' ') {
+            ordered = true;
+            markerLength = digits + 2;
+        }
+    }
+
+    if (markerLength > 0) {
+        closeParagraph(out);
+        closeListsDeeperThan(indent + 1, out); // leaves lists at this indent or shallower
+        if (!lists.empty() && lists.back().indent == indent && lists.back().ordered != ordered) {
+            closeListsDeeperThan(indent, out);
+        }
+        if (lists.empty() || lists.back().indent < indent) {
+            out += ordered ? "<ol style='margin:0 0 0 18px;'>" : "<ul style='margin:0 0 0 18px;'>";
+            lists.push_back({indent, ordered});
+        } else {
+            out += "</li>";
+        }
+        out += "<li>";
+        renderInline(content.substr(markerLength), out);
+        out += '\n';
+        return;
+    }
+
+    // Indented text under a list item continues that item
+    if (!lists.empty() && indent > 0) {
+        out += "<br>";
+        renderInline(content, out);
+        out += '\n';
+        return;
+    }
+
+    closeListsDeeperThan(0, out);
+    if (inParagraph) {
+        out += "<br>\n";
+    } else {
+        out += "<p style='margin:0 0 10px;'>";
+        inParagraph = true;
+    }
+    renderInline(content, out);
+}
+
+// Escapes and applies inline markup; spans never cross a line, unclosed ones are closed.
+// Overlapping spans (**a *b** c*) are split so the tags still nest.
+void MarkdownRenderer::renderInline(std::string_view text, std::string& out) {
+    bool bold = false;
+    bool emphasis = false;
+    char emphasisMarker = 0; // delimiter that opened the current emphasis span
+    bool code = false;
+    std::pair<std::string_view, std::string_view> openOrder[3]; // (open, close) tags of open spans, innermost last
+    size_t openCount = 0;
+    auto toggle = [&](bool& state, std::string_view openTag, std::string_view closeTag) {
+        state = !state;
+        if (state) {
+            out += openTag;
+            openOrder[openCount++] = {openTag, closeTag};
+            return;
+        }
+        size_t k = 0;
+        while (k < openCount && openOrder[k].second != closeTag) ++k;
+        for (size_t inner = openCount; inner-- > k + 1;) out += openOrder[inner].second;
+        out += closeTag;
+        for (size_t inner = k + 1; inner < openCount; ++inner) out += openOrder[inner].first;
+        std::copy(openOrder + k + 1, openOrder + openCount, openOrder + k);
+        --openCount;
+    };
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '`') {
+            toggle(code, "<code>", "</code>");
+            continue;
+        }
+        if (!code && c == '*' && i + 1 < text.size() && text[i + 1] == '*') {
+            toggle(bold, "<strong>", "</strong>");
+            ++i;
+            continue;
+        }
+        if (!code && (c == '*' || c == '_')) {
+            // Only flanking markers count, so "2 * 3" and snake_case stay literal
+            bool canOpen = !emphasis && i + 1 < text.size() && text[i + 1] != ' ' &&
+                           (i == 0 || !std::isalnum(static_cast<unsigned char>(text[i - 1])));
+            // A span opened with * closes only on *, and _ only on _
+            bool canClose = emphasis && c == emphasisMarker && i > 0 && text[i - 1] != ' ' &&
+                            (i + 1 == text.size() || !std::isalnum(static_cast<unsigned char>(text[i + 1])));
+            if (canOpen || canClose) {
+                if (canOpen) emphasisMarker = c;
+                toggle(emphasis, "<em>", "</em>");
+                continue;
+            }
+        }
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out += c;
+        }
+    }
+    while (openCount > 0) out += openOrder[--openCount].second;
+}
+
+// symtomanalysi implementation
+void SymptomAnalysis::addCondition(std::string condition, std::string description, int confidence) {
+    possibleConditions.emplace_back(std::move(condition), std::move(description), confidence);
+}
+
+void SymptomAnalysis::addRecommendation(std::string recommendation) {
+    recommendations.push_back(std::move(recommendation));
+}
+
+void SymptomAnalysis::addWarningSign(std::string warning) {
+    warningSignsWarnings.push_back(std::move(warning));
+}
+
+void SymptomAnalysis::addSuggestedSpecialty(std::string specialty) {
+    suggestedSpecialties.push_back(std::move(specialty));
+}
+
+void SymptomAnalysis::renderHtmlResults(const TemplateLibrary& templates, std::string& out, bool includeMainText) const {
+    // Show extracted main AI text (if available)
+    if (includeMainText && !mainAIText.empty()) {
+        templates.get("ai_main_text_head").render(out, {});
+        MarkdownRenderer::render(mainAIText, out);
+        templates.get("ai_main_text_tail").render(out, {});
+    }
+
+    std::string rawHtml;
+    if (rawAIResponse.empty()) {
+        rawHtml = "<i>No raw response available.</i>";
+    } else {
+        HtmlTemplate::appendEscaped(rawHtml, rawAIResponse);
+    }
+
+    std::string conditions;
+    for (const auto& condition : possibleConditions) {
+        const char* confidenceClass = condition.confidence >= 70 ? "high-confidence" : 
+                                      condition.confidence >= 50 ? "medium-confidence" : "low-confidence";
+        const char* badgeClass = condition.confidence >= 70 ? "confidence-high" : 
+                                 condition.confidence >= 50 ? "confidence-medium" : "confidence-low";
+        templates.get("condition").render(conditions, {
+            {"confidenceClass", confidenceClass},
+            {"condition", condition.condition},
+            {"description", condition.description},
+            {"badgeClass", badgeClass},
+            {"confidence", condition.confidence},
+        });
+    }
+
+    std::string recommendationItems;
+    for (const auto& rec : recommendations) {
+        templates.get("list_item").render(recommendationItems, {{"text", rec}});
+    }
+    std::string warningItems;
+    for (const auto& warning : warningSignsWarnings) {
+        templates.get("list_item").render(warningItems, {{"text", warning}});
+    }
+
+    templates.get("analysis_results").render(out, {
+        {"rawResponse", rawHtml},
+        {"conditions", conditions},
+        {"recommendations", recommendationItems},
+        {"warnings", warningItems},
+    });
+}
+
+// JsonStreamParser implementation
+JsonStreamParser::JsonStreamParser(Handler& handler)
+    : handler(handler), state(State::Value), readingKey(false), escaped(false),
+      unicodeDigits(0), unicodeValue(0), highSurrogate(0) {}
+
+bool JsonStreamParser::fail(const char* message) {
+    if (error.empty()) error = message;
+    return false;
+}
+
+void JsonStreamParser::valueFinished() {
+    state = containers.empty() ? State::Done : State::AfterValue;
+}
+
+void JsonStreamParser::appendCodePoint(uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        scratch += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        scratch += static_cast<char>(0xC0 | (codePoint >> 6));
+        scratch += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        scratch += static_cast<char>(0xE0 | (codePoint >> 12));
+        scratch += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        scratch += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        scratch += static_cast<char>(0xF0 | (codePoint >> 18));
+        scratch += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        scratch += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        scratch += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+bool JsonStreamParser::feedStringByte(char c) {
+    if (unicodeDigits > 0) {
+        int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                  : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                  : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) return fail("bad \\u escape");
+        unicodeValue = (unicodeValue << 4) | static_cast<uint32_t>(digit);
+        if (--unicodeDigits > 0) return true;
+
+        if (unicodeValue >= 0xD800 && unicodeValue < 0xDC00) {
+            highSurrogate = unicodeValue; // wait for the low half
+        } else if (unicodeValue >= 0xDC00 && unicodeValue < 0xE000 && highSurrogate) {
+            appendCodePoint(0x10000 + ((highSurrogate - 0xD800) << 10) + (unicodeValue - 0xDC00));
+            highSurrogate = 0;
+        } else {
+            appendCodePoint(unicodeValue >= 0xD800 && unicodeValue < 0xE000 ? 0xFFFD : unicodeValue);
+            highSurrogate = 0;
+        }
+        return true;
+    }
+    if (escaped) {
+        escaped = false;
+        switch (c) {
+            case '"': scratch += '"'; break;
+            case '\\': scratch += '\\'; break;
+            case '/': scratch += '/'; break;
+            case 'b': scratch += '\b'; break;
+            case 'f': scratch += '\f'; break;
+            case 'n': scratch += '\n'; break;
+            case 'r': scratch += '\r'; break;
+            case 't': scratch += '\t'; break;
+            case 'u':
+                unicodeDigits = 4;
+                unicodeValue = 0;
+                return true;
+            default: return fail("bad escape");
+        }
+        if (highSurrogate) highSurrogate = 0;
+        return true;
+    }
+    if (c == '\\') {
+        escaped = true;
+        return true;
+    }
+    if (highSurrogate) {
+        appendCodePoint(0xFFFD); // unpaired high surrogate
+        highSurrogate = 0;
+    }
+    if (c == '"') {
+        if (readingKey) {
+            handler.key(scratch);
+            state = State::Colon;
+        } else {
+            handler.stringValue(scratch);
+            valueFinished();
+        }
+        return true;
+    }
+    if (static_cast<unsigned char>(c) < 0x20) return fail("control character in string");
+    scratch += c;
+    return true;
+}
+
+bool JsonStreamParser::feed(std::string_view bytes) {
+    if (failed()) return false;
+    size_t i = 0;
+    while (i < bytes.size()) {
+        char c = bytes[i];
+        switch (state) {
+            case State::String: {
+                // Copy plain runs in bulk; only quotes and escapes need the slow path
+                if (!escaped && unicodeDigits == 0 && !highSurrogate && c != '"' && c != '\\' &&
+                    static_cast<unsigned char>(c) >= 0x20) {
+                    size_t run = i;
+                    while (run < bytes.size() && bytes[run] != '"' && bytes[run] != '\\' &&
+                           static_cast<unsigned char>(bytes[run]) >= 0x20) {
+                        ++run;
+                    }
+                    scratch.append(bytes.data() + i, run - i);
+                    i = run;
+                    continue;
+                }
+                if (!feedStringByte(c)) return false;
+                ++i;
+                continue;
+            }
+            case State::Number:
+                if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                    scratch += c;
+                    ++i;
+                    continue;
+                }
+                handler.numberValue(scratch);
+                valueFinished();
+                continue; // reprocess this byte as a delimiter
+            case State::Literal:
+                if (std::isalpha(static_cast<unsigned char>(c))) {
+                    scratch += c;
+                    ++i;
+                    continue;
+                }
+                if (scratch != "true" && scratch != "false" && scratch != "null") return fail("bad literal");
+                handler.literalValue(scratch);
+                valueFinished();
+                continue;
+            default:
+                break;
+        }
+
+        ++i;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') continue;
+
+        switch (state) {
+            case State::ArrayValueOrEnd:
+                if (c == ']') {
+                    containers.pop_back();
+                    handler.endArray();
+                    valueFinished();
+                    break;
+                }
+                // fall through
+            case State::Value:
+                if (c == '{') {
+                    containers.push_back('{');
+                    handler.startObject();
+                    state = State::ObjectKeyOrEnd;
+                } else if (c == '[') {
+                    containers.push_back('[');
+                    handler.startArray();
+                    state = State::ArrayValueOrEnd;
+                } else if (c == '"') {
+                    scratch.clear();
+                    readingKey = false;
+                    state = State::String;
+                } else if (c == '-' || std::isdigit(static_cast<unsigned char>(c))) {
+                    scratch.assign(1, c);
+                    state = State::Number;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    scratch.assign(1, c);
+                    state = State::Literal;
+                } else {
+                    return fail("expected a value");
+                }
+                break;
+            case State::ObjectKeyOrEnd:
+                if (c == '}') {
+                    containers.pop_back();
+                    handler.endObject();
+                    valueFinished();
+                    break;
+                }
+                // fall through
+            case State::ObjectKey:
+                if (c != '"') return fail("expected an object key");
+                scratch.clear();
+                readingKey = true;
+                state = State::String;
+                break;
+            case State::Colon:
+                if (c != ':') return fail("expected ':'");
+                state = State::Value;
+                break;
+            case State::AfterValue:
+                if (c == ',') {
+                    state = containers.back() == '{' ? State::ObjectKey : State::Value;
+                } else if ((c == '}' && containers.back() == '{') || (c == ']' && containers.back() == '[')) {
+                    containers.pop_back();
+                    if (c == '}') handler.endObject();
+                    else handler.endArray();
+                    valueFinished();
+                } else {
+                    return fail("expected ',' or a closing bracket");
+                }
+                break;
+            case State::Done:
+                return fail("trailing data after JSON value");
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool JsonStreamParser::finish() {
+    if (failed()) return false;
+    // A number or literal at the very end of input has no delimiter to close it
+    if (state == State::Number || state == State::Literal) feed(" ");
+    if (state != State::Done) return fail("truncated JSON");
+    return !failed();
+}
+
+// GeminiReplyParser implementation
+void GeminiReplyParser::enter(const char* marker) {
+    // A container stored under a key records the key first, so paths read like
+    // "candidates [] {} content {} parts [] {}"
+    if (!pendingKey.empty()) {
+        path.push_back(pendingKey);
+        pendingKey.clear();
+    }
+    path.push_back(marker);
+}
+
+void GeminiReplyParser::leave() {
+    path.pop_back();
+    if (!path.empty() && path.back() != "{}" && path.back() != "[]") path.pop_back();
+}
+
+bool GeminiReplyParser::pathEndsWith(std::initializer_list<const char*> suffix) const {
+    if (path.size() < suffix.size()) return false;
+    size_t offset = path.size() - suffix.size();
+    for (const char* part : suffix) {
+        if (path[offset++] != part) return false;
+    }
+    return true;
+}
+
+void GeminiReplyParser::stringValue(std::string_view value) {
+    if (pendingKey == "text" && pathEndsWith({"candidates", "[]", "{}", "content", "{}", "parts", "[]", "{}"})) {
+        reply.text.append(value);
+        if (onText) onText(value);
+    } else if (pendingKey == "message" && pathEndsWith({"error", "{}"})) {
+        reply.apiError.assign(value);
+    }
+    pendingKey.clear();
+}
+
+void GeminiReplyParser::numberValue(std::string_view value) {
+    if (pathEndsWith({"usageMetadata", "{}"})) {
+        long number = std::strtol(std::string(value).c_str(), nullptr, 10);
+        // Streamed replies repeat usageMetadata with running totals; keep the latest
+        if (pendingKey == "promptTokenCount") reply.promptTokens = number;
+        else if (pendingKey == "candidatesTokenCount") reply.candidateTokens = number;
+        else if (pendingKey == "totalTokenCount") reply.totalTokens = number;
+    }
+    pendingKey.clear();
+}
+
+// JsonWriter implementation
+void JsonWriter::appendEscaped(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            // Copy the plain ASCII run in one append
+            size_t run = i + 1;
+            while (run < text.size()) {
+                unsigned char next = static_cast<unsigned char>(text[run]);
+                if (next < 0x20 || next >= 0x80 || next == '"' || next == '\\') break;
+                ++run;
+            }
+            out.append(text.data() + i, run - i);
+            i = run;
+            continue;
+        }
+        if (c < 0x80) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+            }
+            ++i;
+            continue;
+        }
+
+        // Multi-byte UTF-8: copy well-formed sequences, replace anything else
+        size_t length = c >= 0xF0 && c <= 0xF4 ? 4 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xC2 && c <= 0xDF ? 2 : 0;
+        bool valid = length > 0 && i + length <= text.size();
+        for (size_t k = 1; valid && k < length; ++k) {
+            valid = (static_cast<unsigned char>(text[i + k]) & 0xC0) == 0x80;
+        }
+        if (valid && length == 3) {
+            unsigned char second = static_cast<unsigned char>(text[i + 1]);
+            valid = !(c == 0xE0 && second < 0xA0) && !(c == 0xED && second >= 0xA0); // overlong, surrogate
+        } else if (valid && length == 4) {
+            unsigned char second = static_cast<unsigned char>(text[i + 1]);
+            valid = !(c == 0xF0 && second < 0x90) && !(c == 0xF4 && second >= 0x90);
+        }
+        if (valid) {
+            out.append(text.data() + i, length);
+            i += length;
+        } else {
+            out += "\xEF\xBF\xBD";
+            ++i;
+        }
+    }
+}
+
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!hasMembers.empty()) {
+        if (hasMembers.back()) out += ',';
+        hasMembers.back() = true;
+    }
+}
+
+JsonWriter& JsonWriter::beginObject() {
+    separate();
+    out += '{';
+    hasMembers.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    out += '}';
+    hasMembers.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+    separate();
+    out += '[';
+    hasMembers.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    out += ']';
+    hasMembers.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    separate();
+    out += '"';
+    appendEscaped(out, name);
+    out += "\":";
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view text) {
+    separate();
+    out += '"';
+    appendEscaped(out, text);
+    out += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(long long number) {
+    separate();
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%lld", number);
+    out.append(text, static_cast<size_t>(length));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double number) {
+    separate();
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.15g", number); // round-trips the configured values
+    out.append(text, static_cast<size_t>(length));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    separate();
+    out += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(std::string_view json) {
+    separate();
+    out.append(json);
+    return *this;
+}
+
+// GeminiPayloadBuilder implementation
+GeminiPayloadBuilder::GeminiPayloadBuilder(const GeminiPromptOptions& options) {
+    JsonWriter writer(head);
+    writer.beginObject();
+    if (!options.systemInstruction.empty()) {
+        writer.key("systemInstruction").beginObject()
+              .key("parts").beginArray().beginObject().key("text").value(options.systemInstruction).endObject().endArray()
+              .endObject();
+    }
+    writer.key("generationConfig").beginObject()
+          .key("temperature").value(options.temperature)
+          .key("topP").value(options.topP)
+          .key("maxOutputTokens").value(options.maxOutputTokens)
+          .endObject();
+    writer.key("contents").beginArray().beginObject()
+          .key("role").value("user")
+          .key("parts").beginArray().beginObject().key("text");
+    head += '"'; // the prompt string is spliced in here per request
+    tail = "\"}]}]}";
+
+    // Split the prompt template into pre-escaped literals and the per-request fields
+    const std::string& source = options.promptTemplate;
+    size_t pos = 0;
+    while (pos < source.size()) {
+        size_t open = source.find("{{", pos);
+        size_t close = open == std::string::npos ? std::string::npos : source.find("}}", open + 2);
+        std::string name = close == std::string::npos ? "" : source.substr(open + 2, close - open - 2);
+        Field field = name == "symptoms" ? Symptoms : name == "duration" ? Duration : name == "severity" ? Severity : Literal;
+
+        size_t literalEnd = field == Literal ? (close == std::string::npos ? source.size() : close + 2) : open;
+        if (literalEnd > pos) {
+            Segment segment{Literal, std::string()};
+            JsonWriter::appendEscaped(segment.text, std::string_view(source).substr(pos, literalEnd - pos));
+            fixedBytes += segment.text.size();
+            prompt.push_back(std::move(segment));
+        }
+        if (field != Literal) prompt.push_back({field, std::string()});
+        pos = field == Literal ? literalEnd : close + 2;
+    }
+    fixedBytes += head.size() + tail.size();
+}
+
+std::string GeminiPayloadBuilder::build(std::string_view symptoms, std::string_view duration, int severity) const {
+    std::string payload;
+    // Escaping can grow text; one reservation covers the common case
+    payload.reserve(fixedBytes + symptoms.size() + symptoms.size() / 8 + duration.size() + 32);
+    payload += head;
+    for (const auto& segment : prompt) {
+        switch (segment.field) {
+            case Literal: payload += segment.text; break;
+            case Symptoms: JsonWriter::appendEscaped(payload, symptoms); break;
+            case Duration: JsonWriter::appendEscaped(payload, duration.empty() ? "Not specified" : duration); break;
+            case Severity: payload += std::to_string(severity); break;
+        }
+    }
+    payload += tail;
+    return payload;
+}
+
+// Metrics implementation
+size_t metricShardIndex() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local const size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % MetricShards;
+    return shard;
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards) total += shard.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+size_t Histogram::bucketFor(uint64_t value) {
+    if (value < 16) return static_cast<size_t>(value);
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > 39) return BucketCount - 1;
+    // 16 + 8 per octave above 16, then the 3 bits after the leading one pick the sub-bucket
+    return 16 + static_cast<size_t>(msb - 4) * 8 + static_cast<size_t>((value >> (msb - 3)) & 7);
+}
+
+uint64_t Histogram::bucketUpperBound(size_t bucket) {
+    if (bucket < 16) return bucket;
+    size_t octave = (bucket - 16) / 8;
+    size_t sub = (bucket - 16) % 8;
+    int shift = static_cast<int>(octave) + 1; // msb - 3
+    return ((8 + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t Histogram::Snapshot::quantile(double fraction) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * count));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank && buckets[bucket] > 0) return bucketUpperBound(bucket);
+    }
+    return bucketUpperBound(buckets.size() - 1);
+}
+
+Histogram::Histogram(Unit unit) : shards(std::make_unique<Shard[]>(MetricShards)), unit(unit) {}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot result;
+    result.buckets.assign(BucketCount, 0);
+    for (size_t i = 0; i < MetricShards; ++i) {
+        const Shard& shard = shards[i];
+        for (size_t bucket = 0; bucket < BucketCount; ++bucket) {
+            result.buckets[bucket] += shard.buckets[bucket].load(std::memory_order_relaxed);
+        }
+        result.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    for (uint64_t n : result.buckets) result.count += n;
+    return result;
+}
+
+MetricsRegistry::Series& MetricsRegistry::series(const std::string& name, const std::string& help, const char* type,
+                                                 const std::string& labels) {
+    Family* family = nullptr;
+    for (auto& existing : families) {
+        if (existing->name == name) family = existing.get();
+    }
+    if (!family) {
+        families.push_back(std::make_unique<Family>());
+        family = families.back().get();
+        family->name = name;
+        family->help = help;
+        family->type = type;
+    }
+    for (Series& existing : family->series) {
+        if (existing.labels == labels) return existing;
+    }
+    family->series.emplace_back();
+    family->series.back().labels = labels;
+    return family->series.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series& entry = series(name, help, "counter", labels);
+    if (!entry.counter) entry.counter = std::make_unique<Counter>();
+    return *entry.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series& entry = series(name, help, "gauge", labels);
+    if (!entry.gauge) entry.gauge = std::make_unique<Gauge>();
+    return *entry.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                                      Histogram::Unit unit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series& entry = series(name, help, "histogram", labels);
+    if (!entry.histogram) entry.histogram = std::make_unique<Histogram>(unit);
+    return *entry.histogram;
+}
+
+void MetricsRegistry::callback(const std::string& name, const std::string& help, const char* type,
+                               std::function<double()> read, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    series(name, help, type, labels).read = std::move(read);
+}
+
+static void appendMetricLine(std::string& out, const std::string& name, const std::string& labels,
+                             const std::string& extraLabel, double value) {
+    out += name;
+    if (!labels.empty() || !extraLabel.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extraLabel.empty()) out += ',';
+        out += extraLabel;
+        out += '}';
+    }
+    char number[32];
+    snprintf(number, sizeof(number), " %.9g\n", value);
+    out += number;
+}
+
+std::string MetricsRegistry::render() const {
+    // Prometheus buckets are coarse fixed bounds; the fine buckets are folded into them
+    static const double secondBounds[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                          0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+    static const double countBounds[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+
+    std::string out;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& family : families) {
+        out += "# HELP " + family->name + " " + family->help + "\n";
+        out += "# TYPE " + family->name + " " + family->type + "\n";
+        std::string quantileLines;
+        for (const Series& entry : family->series) {
+            if (entry.counter) {
+                appendMetricLine(out, family->name, entry.labels, "", static_cast<double>(entry.counter->value()));
+            } else if (entry.gauge) {
+                appendMetricLine(out, family->name, entry.labels, "", static_cast<double>(entry.gauge->value()));
+            } else if (entry.read) {
+                appendMetricLine(out, family->name, entry.labels, "", entry.read());
+            } else if (entry.histogram) {
+                Histogram::Snapshot snapshot = entry.histogram->snapshot();
+                bool seconds = entry.histogram->getUnit() == Histogram::Unit::Seconds;
+                double scale = seconds ? 1e-6 : 1.0;
+                const double* bounds = seconds ? secondBounds : countBounds;
+                size_t boundCount = seconds ? std::size(secondBounds) : std::size(countBounds);
+
+                uint64_t cumulative = 0;
+                size_t bucket = 0;
+                char le[48];
+                for (size_t i = 0; i < boundCount; ++i) {
+                    while (bucket < snapshot.buckets.size() && Histogram::bucketUpperBound(bucket) * scale <= bounds[i]) {
+                        cumulative += snapshot.buckets[bucket++];
+                    }
+                    snprintf(le, sizeof(le), "le=\"%g\"", bounds[i]);
+                    appendMetricLine(out, family->name + "_bucket", entry.labels, le, static_cast<double>(cumulative));
+                }
+                appendMetricLine(out, family->name + "_bucket", entry.labels, "le=\"+Inf\"",
+                                 static_cast<double>(snapshot.count));
+                appendMetricLine(out, family->name + "_sum", entry.labels, "", snapshot.sum * scale);
+                appendMetricLine(out, family->name + "_count", entry.labels, "", static_cast<double>(snapshot.count));
+
+                for (double fraction : quantiles) {
+                    snprintf(le, sizeof(le), "quantile=\"%g\"", fraction);
+                    appendMetricLine(quantileLines, family->name + "_quantile", entry.labels, le,
+                                     snapshot.quantile(fraction) * scale);
+                }
+            }
+        }
+        // p50/p90/p99 straight from the fine buckets, as a companion gauge family
+        if (!quantileLines.empty()) {
+            out += "# HELP " + family->name + "_quantile Quantiles of " + family->name + " (within 12.5%)\n";
+            out += "# TYPE " + family->name + "_quantile gauge\n";
+            out += quantileLines;
+        }
+    }
+    return out;
+}
+
+// AsyncAIClient implementation
+AsyncAIClient::AsyncAIClient(size_t maxPooledHandles)
+    : multi(curl_multi_init()), share(curl_share_init()), jsonHeaders(nullptr),
+      maxPooledHandles(maxPooledHandles), stopping(false) {
+    // Only the loop thread touches handles, so the share needs no lock callbacks
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(maxPooledHandles));
+    jsonHeaders = curl_slist_append(jsonHeaders, "Content-Type: application/json");
+    loopThread = std::thread(&AsyncAIClient::eventLoop, this);
+}
+
+AsyncAIClient::~AsyncAIClient() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    curl_multi_wakeup(multi);
+    if (loopThread.joinable()) loopThread.join();
+
+    for (CURL* easy : idleHandles) {
+        curl_easy_cleanup(easy);
+    }
+    curl_multi_cleanup(multi);
+    curl_share_cleanup(share);
+    curl_slist_free_all(jsonHeaders);
+}
+
+size_t AsyncAIClient::writeBody(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t totalSize = size * nmemb;
+    Transfer* transfer = static_cast<Transfer*>(userp);
+    transfer->result.body.append(static_cast<char*>(contents), totalSize);
+    if (transfer->onData) transfer->onData(std::string_view(static_cast<char*>(contents), totalSize));
+    return totalSize;
+}
+
+void AsyncAIClient::post(const std::string& url, std::string payload, long timeoutMs, Callback callback,
+                         DataCallback onData, CancelToken cancel) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->url = url;
+    transfer->payload = std::move(payload);
+    transfer->timeoutMs = timeoutMs;
+    transfer->callback = std::move(callback);
+    transfer->onData = std::move(onData);
+    transfer->cancel = std::move(cancel);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            transfer->result.error = "client is shutting down";
+            transfer->callback(std::move(transfer->result));
+            return;
+        }
+        pending.push_back(std::move(transfer));
+    }
+    curl_multi_wakeup(multi);
+}
+
+std::future<AIHttpResult> AsyncAIClient::post(const std::string& url, std::string payload, long timeoutMs,
+                                              DataCallback onData) {
+    auto promise = std::make_shared<std::promise<AIHttpResult>>();
+    std::future<AIHttpResult> future = promise->get_future();
+    post(url, std::move(payload), timeoutMs, [promise](AIHttpResult result) {
+        promise->set_value(std::move(result));
+    }, std::move(onData));
+    return future;
+}
+
+void AsyncAIClient::cancel(const CancelToken& token) {
+    token->store(true);
+    curl_multi_wakeup(multi);
+}
+
+CURL* AsyncAIClient::acquireHandle() {
+    if (!idleHandles.empty()) {
+        CURL* easy = idleHandles.back();
+        idleHandles.pop_back();
+        return easy;
+    }
+    CURL* easy = curl_easy_init();
+    if (easy) {
+        curl_easy_setopt(easy, CURLOPT_SHARE, share);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, jsonHeaders);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeBody);
+    }
+    return easy;
+}
+
+void AsyncAIClient::releaseHandle(CURL* easy) {
+    if (idleHandles.size() < maxPooledHandles) {
+        idleHandles.push_back(easy);
+    } else {
+        curl_easy_cleanup(easy);
+    }
+}
+
+void AsyncAIClient::startPending() {
+    std::deque<std::unique_ptr<Transfer>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+
+    for (auto& transfer : batch) {
+        if (transfer->cancel && *transfer->cancel) {
+            transfer->result.error = "cancelled";
+            transfer->callback(std::move(transfer->result));
+            continue;
+        }
+        CURL* easy = acquireHandle();
+        if (!easy) {
+            transfer->result.error = "curl_easy_init failed";
+            transfer->callback(std::move(transfer->result));
+            continue;
+        }
+        transfer->easy = easy;
+        transfer->startedAt = std::chrono::steady_clock::now();
+        curl_easy_setopt(easy, CURLOPT_URL, transfer->url.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, transfer->payload.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(transfer->payload.size()));
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, transfer->timeoutMs);
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, std::min(transfer->timeoutMs, 10000L));
+        curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, transfer->errorBuffer);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+        curl_multi_add_handle(multi, easy);
+        activeHandles.push_back(easy);
+        transfer.release(); // owned by the multi handle until finishTransfer
+    }
+}
+
+void AsyncAIClient::finishTransfer(CURL* easy, CURLcode code) {
+    Transfer* raw = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, reinterpret_cast<char**>(&raw));
+    std::unique_ptr<Transfer> transfer(raw);
+    curl_multi_remove_handle(multi, easy);
+    activeHandles.erase(std::remove(activeHandles.begin(), activeHandles.end(), easy), activeHandles.end());
+
+    AIHttpResult& result = transfer->result;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &result.httpStatus);
+    result.elapsedMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - transfer->startedAt).count();
+    if (code != CURLE_OK) {
+        result.error = transfer->errorBuffer[0] ? transfer->errorBuffer : curl_easy_strerror(code);
+    } else if (result.httpStatus < 200 || result.httpStatus >= 300) {
+        result.error = "HTTP status " + std::to_string(result.httpStatus);
+    } else {
+        result.ok = true;
+    }
+
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, nullptr);
+    releaseHandle(easy);
+    transfer->callback(std::move(result));
+}
+
+void AsyncAIClient::abortCancelled() {
+    std::vector<CURL*> active(activeHandles); // finishTransfer edits activeHandles
+    for (CURL* easy : active) {
+        Transfer* transfer = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, reinterpret_cast<char**>(&transfer));
+        if (transfer->cancel && *transfer->cancel) {
+            snprintf(transfer->errorBuffer, sizeof(transfer->errorBuffer), "cancelled");
+            finishTransfer(easy, CURLE_ABORTED_BY_CALLBACK);
+        }
+    }
+}
+
+void AsyncAIClient::eventLoop() {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) break;
+        }
+        startPending();
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+
+        int queued = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+            if (message->msg == CURLMSG_DONE) {
+                finishTransfer(message->easy_handle, message->data.result);
+            }
+        }
+        abortCancelled();
+
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    // Fail anything still queued or in flight so no caller waits forever
+    startPending();
+    while (!activeHandles.empty()) {
+        finishTransfer(activeHandles.back(), CURLE_ABORTED_BY_CALLBACK);
+    }
+}
+
+// CircuitBreaker implementation
+CircuitBreaker::CircuitBreaker(size_t window, size_t minRequests, double failureRatio, std::chrono::milliseconds openFor)
+    : state(State::Closed), outcomes(std::max<size_t>(window, 1), 0), nextOutcome(0), recorded(0), failures(0),
+      minRequests(minRequests), failureRatio(failureRatio), openFor(openFor), probeInFlight(false) {}
+
+void CircuitBreaker::resetWindow() {
+    std::fill(outcomes.begin(), outcomes.end(), 0);
+    nextOutcome = 0;
+    recorded = 0;
+    failures = 0;
+}
+
+bool CircuitBreaker::allowRequest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (state == State::Closed) return true;
+    if (state == State::Open && std::chrono::steady_clock::now() - openedAt >= openFor) {
+        state = State::HalfOpen;
+        probeInFlight = false;
+    }
+    if (state == State::HalfOpen && !probeInFlight) {
+        probeInFlight = true;
+        return true;
+    }
+    return false;
+}
+
+void CircuitBreaker::record(bool success) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (state == State::HalfOpen) {
+        probeInFlight = false;
+        if (success) {
+            state = State::Closed;
+            resetWindow();
+            std::cerr << "Gemini circuit breaker closed: probe succeeded" << std::endl;
+        } else {
+            state = State::Open;
+            openedAt = std::chrono::steady_clock::now();
+        }
+        return;
+    }
+    if (state == State::Open) return; // a straggler from before the trip
+
+    failures -= outcomes[nextOutcome];
+    outcomes[nextOutcome] = success ? 0 : 1;
+    failures += outcomes[nextOutcome];
+    nextOutcome = (nextOutcome + 1) % outcomes.size();
+    recorded = std::min(recorded + 1, outcomes.size());
+
+    if (recorded >= minRequests && failures >= failureRatio * recorded) {
+        state = State::Open;
+        openedAt = std::chrono::steady_clock::now();
+        std::cerr << "Gemini circuit breaker open: " << failures << " of the last " << recorded
+                  << " calls failed; using the fallback for " << openFor.count() << " ms" << std::endl;
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::getState() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
+
+// LatencyWindow implementation
+LatencyWindow::LatencyWindow(size_t capacity) : capacity(std::max<size_t>(capacity, 1)), nextSample(0) {
+    samples.reserve(this->capacity);
+}
+
+void LatencyWindow::add(double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (samples.size() < capacity) {
+        samples.push_back(ms);
+    } else {
+        samples[nextSample] = ms;
+    }
+    nextSample = (nextSample + 1) % capacity;
+}
+
+std::optional<double> LatencyWindow::percentile(double fraction, size_t minSamples) {
+    std::vector<double> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples.empty() || samples.size() < minSamples) return std::nullopt;
+        sorted = samples;
+    }
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+static std::vector<std::string> splitFields(const std::string& line, char separator) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(separator, start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return fields;
+}
+
+// SymptomClassifier implementation
+static unsigned char foldCase(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// UTF-8 lead/continuation bytes count as letters, so "café" is one word
+static bool isWordByte(unsigned char c) {
+    return std::isalnum(c) || c >= 0x80;
+}
+
+static std::string trimmed(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t");
+    if (begin == std::string::npos) return "";
+    size_t end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+std::shared_ptr<const SymptomClassifier> SymptomClassifier::load(const std::string& path, std::string& error) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        error = path + ": cannot open";
+        return nullptr;
+    }
+
+    std::vector<Rule> rules;
+    std::vector<std::vector<std::string>> ruleKeywords;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields = splitFields(line, '\t');
+        if (fields.size() != 5) {
+            error = path + ":" + std::to_string(lineNumber) + ": expected 5 fields, got " + std::to_string(fields.size());
+            return nullptr;
+        }
+        Rule rule;
+        rule.condition = trimmed(fields[0]);
+        rule.description = trimmed(fields[1]);
+        rule.confidence = std::atoi(fields[2].c_str());
+        if (rule.condition.empty() || rule.confidence <= 0 || rule.confidence > 100) {
+            error = path + ":" + std::to_string(lineNumber) + ": needs a condition and a confidence in 1-100";
+            return nullptr;
+        }
+        for (const std::string& specialty : splitFields(fields[3], ';')) {
+            std::string name = trimmed(specialty);
+            if (!name.empty()) rule.specialties.push_back(std::move(name));
+        }
+        std::vector<std::string> keywords;
+        for (const std::string& keyword : splitFields(fields[4], ';')) {
+            std::string text = trimmed(keyword);
+            if (!text.empty()) keywords.push_back(std::move(text));
+        }
+        if (keywords.empty()) {
+            error = path + ":" + std::to_string(lineNumber) + ": no keywords";
+            return nullptr;
+        }
+        rules.push_back(std::move(rule));
+        ruleKeywords.push_back(std::move(keywords));
+    }
+    return compile(std::move(rules), ruleKeywords, error);
+}
+
+std::shared_ptr<const SymptomClassifier> SymptomClassifier::compile(
+    std::vector<Rule> rules, const std::vector<std::vector<std::string>>& ruleKeywords, std::string& error) {
+    auto classifier = std::make_shared<SymptomClassifier>();
+    classifier->rules = std::move(rules);
+
+    // Parse "word*:weight" and collect the folded patterns
+    std::vector<std::string> patterns;
+    for (size_t r = 0; r < ruleKeywords.size() && r < classifier->rules.size(); ++r) {
+        for (const std::string& spec : ruleKeywords[r]) {
+            std::string text = spec;
+            double weight = 1.0;
+            size_t colon = text.rfind(':');
+            if (colon != std::string::npos) {
+                char* end = nullptr;
+                weight = std::strtod(text.c_str() + colon + 1, &end);
+                if (end == text.c_str() + colon + 1 || *end != '\0' || weight <= 0) {
+                    error = "keyword \"" + spec + "\": bad weight";
+                    return nullptr;
+                }
+                text.resize(colon);
+            }
+            bool prefix = !text.empty() && text.back() == '*';
+            if (prefix) text.pop_back();
+            text = trimmed(text);
+            if (text.empty()) {
+                error = "rule \"" + classifier->rules[r].condition + "\": empty keyword";
+                return nullptr;
+            }
+            for (char& c : text) c = static_cast<char>(foldCase(static_cast<unsigned char>(c)));
+            classifier->keywords.push_back({static_cast<uint32_t>(r), static_cast<uint32_t>(text.size()), weight, prefix});
+            patterns.push_back(std::move(text));
+        }
+    }
+
+    // Only bytes that occur in some keyword get their own class; everything else shares class 0
+    uint8_t folded[256] = {0};
+    for (const std::string& pattern : patterns) {
+        for (unsigned char c : pattern) {
+            if (folded[c]) continue;
+            if (classifier->classCount == 256) {
+                error = "keywords use too many distinct bytes";
+                return nullptr;
+            }
+            folded[c] = static_cast<uint8_t>(classifier->classCount++);
+        }
+    }
+    for (int c = 0; c < 256; ++c) classifier->byteClass[c] = folded[foldCase(static_cast<unsigned char>(c))];
+
+    // Trie; 0 marks a missing edge since nothing ever transitions back into the root
+    const uint32_t classes = classifier->classCount;
+    std::vector<uint32_t>& next = classifier->transitions;
+    auto& outputs = classifier->outputs;
+    next.assign(classes, 0);
+    outputs.emplace_back();
+    for (size_t k = 0; k < patterns.size(); ++k) {
+        uint32_t state = 0;
+        for (unsigned char c : patterns[k]) {
+            uint32_t& edge = next[state * classes + folded[c]];
+            if (edge == 0) {
+                edge = static_cast<uint32_t>(outputs.size());
+                outputs.emplace_back();
+                next.resize(next.size() + classes, 0);
+            }
+            state = next[state * classes + folded[c]]; // re-read: resize may have moved edge
+        }
+        outputs[state].push_back(static_cast<uint32_t>(k));
+    }
+
+    // Breadth-first fail links, filling every missing edge so scanning never backtracks
+    std::vector<uint32_t> fail(outputs.size(), 0);
+    std::vector<uint32_t> queue;
+    for (uint32_t c = 0; c < classes; ++c) {
+        if (next[c] != 0) queue.push_back(next[c]);
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        const std::vector<uint32_t>& inherited = outputs[fail[state]];
+        outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+        for (uint32_t c = 0; c < classes; ++c) {
+            uint32_t& edge = next[state * classes + c];
+            uint32_t fallback = next[fail[state] * classes + c];
+            if (edge != 0) {
+                fail[edge] = fallback;
+                queue.push_back(edge);
+            } else {
+                edge = fallback;
+            }
+        }
+    }
+    return classifier;
+}
+
+void SymptomClassifier::scan(std::string_view text, std::vector<char>& matched) const {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        state = transitions[state * classCount + byteClass[bytes[i]]];
+        for (uint32_t k : outputs[state]) {
+            const Keyword& keyword = keywords[k];
+            size_t begin = i + 1 - keyword.length;
+            if (begin > 0 && isWordByte(bytes[begin - 1])) continue;
+            if (!keyword.prefix && i + 1 < text.size() && isWordByte(bytes[i + 1])) continue;
+            matched[k] = 1;
+        }
+    }
+}
+
+SymptomClassifier::Classification SymptomClassifier::classify(std::string_view symptoms, std::string_view aiText) const {
+    std::vector<double> ruleScores(rules.size(), 0.0);
+    std::vector<char> matched(keywords.size(), 0);
+    // A keyword counts once per source however often it is repeated
+    for (const auto& [text, sourceWeight] : {std::make_pair(symptoms, SymptomWeight), std::make_pair(aiText, AITextWeight)}) {
+        std::fill(matched.begin(), matched.end(), 0);
+        scan(text, matched);
+        for (size_t k = 0; k < keywords.size(); ++k) {
+            if (matched[k]) ruleScores[keywords[k].rule] += keywords[k].weight * sourceWeight;
+        }
+    }
+
+    Classification result;
+    for (size_t r = 0; r < rules.size(); ++r) {
+        if (ruleScores[r] < 1.0) continue;
+        int confidence = std::min(95, rules[r].confidence + static_cast<int>(5 * (ruleScores[r] - 1.0)));
+        result.conditions.push_back({&rules[r], ruleScores[r], std::max(confidence, rules[r].confidence)});
+    }
+    std::stable_sort(result.conditions.begin(), result.conditions.end(),
+                     [](const ConditionScore& a, const ConditionScore& b) { return a.score > b.score; });
+
+    for (const ConditionScore& condition : result.conditions) {
+        for (const std::string& specialty : condition.rule->specialties) {
+            auto it = std::find_if(result.specialties.begin(), result.specialties.end(),
+                                   [&](const auto& entry) { return entry.first == specialty; });
+            if (it == result.specialties.end()) {
+                result.specialties.emplace_back(specialty, condition.score);
+            } else {
+                it->second += condition.score;
+            }
+        }
+    }
+    std::stable_sort(result.specialties.begin(), result.specialties.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    return result;
+}
+
+// TriageModel implementation
+std::shared_ptr<const TriageModel> TriageModel::load(const std::string& path, std::string& error) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        error = path + ": cannot open";
+        return nullptr;
+    }
+
+    auto model = std::make_shared<TriageModel>();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields = splitFields(line, '\t');
+        std::string where = path + ":" + std::to_string(lineNumber) + ": ";
+        if (fields[0] == "label") {
+            // label <condition> <bias> <specialties> <description> <advice>
+            if (!model->vocabulary.empty()) {
+                error = where + "labels must come before features";
+                return nullptr;
+            }
+            if (fields.size() != 6) {
+                error = where + "expected 6 fields for a label, got " + std::to_string(fields.size());
+                return nullptr;
+            }
+            Label label;
+            label.condition = trimmed(fields[1]);
+            label.description = trimmed(fields[4]);
+            label.advice = trimmed(fields[5]);
+            for (const std::string& specialty : splitFields(fields[3], ';')) {
+                std::string name = trimmed(specialty);
+                if (!name.empty()) label.specialties.push_back(std::move(name));
+            }
+            model->labels.push_back(std::move(label));
+            model->bias.push_back(std::strtod(fields[2].c_str(), nullptr));
+            continue;
+        }
+
+        // <feature> <one weight per label>; a feature is a word or two words separated by a space
+        if (fields.size() != model->labels.size() + 1) {
+            error = where + "expected " + std::to_string(model->labels.size()) + " weights";
+            return nullptr;
+        }
+        std::string feature = trimmed(fields[0]);
+        for (char& c : feature) c = static_cast<char>(foldCase(static_cast<unsigned char>(c)));
+        if (feature.empty() || !model->vocabulary.emplace(feature, model->vocabulary.size()).second) {
+            error = where + "empty or repeated feature";
+            return nullptr;
+        }
+        for (size_t i = 1; i < fields.size(); ++i) {
+            char* end = nullptr;
+            double weight = std::strtod(fields[i].c_str(), &end);
+            if (end == fields[i].c_str()) {
+                error = where + "bad weight \"" + fields[i] + "\"";
+                return nullptr;
+            }
+            model->weights.push_back(weight);
+        }
+    }
+    if (model->labels.empty()) {
+        error = path + ": no labels";
+        return nullptr;
+    }
+    return model;
+}
+
+TriageModel::Prediction TriageModel::predict(std::string_view text) const {
+    // Binary bag of words: each distinct unigram or bigram counts once
+    std::vector<uint32_t> rows;
+    std::string word;
+    std::string previous;
+    std::string feature;
+    auto lookup = [&](const std::string& key) {
+        auto it = vocabulary.find(key);
+        if (it != vocabulary.end()) rows.push_back(it->second);
+    };
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (isWordByte(c)) {
+            word += static_cast<char>(foldCase(c));
+            continue;
+        }
+        if (word.empty()) continue;
+        lookup(word);
+        if (!previous.empty()) {
+            feature.assign(previous).append(1, ' ').append(word);
+            lookup(feature);
+        }
+        previous.swap(word);
+        word.clear();
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    const size_t count = labels.size();
+    std::vector<double> scores(bias);
+    for (uint32_t row : rows) {
+        const double* weight = &weights[row * count];
+        for (size_t label = 0; label < count; ++label) scores[label] += weight[label];
+    }
+
+    // Softmax, shifted by the maximum so exp() cannot overflow
+    size_t best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+    double total = 0;
+    for (double score : scores) total += std::exp(score - scores[best]);
+    return {&labels[best], 1.0 / total};
+}
+
+// AIService implementation
+AIService::AIService(const std::string& key, const std::string& baseUrl,
+                     const GeminiPromptOptions& promptOptions,
+                     std::shared_ptr<const SymptomClassifier> classifier, long requestTimeoutMs,
+                     const GeminiResilienceOptions& resilience)
+    : apiKey(key), baseUrl(baseUrl), payloadBuilder(promptOptions), classifier(std::move(classifier)),
+      requestTimeoutMs(requestTimeoutMs), resilience(resilience),
+      breaker(resilience.breakerWindow, resilience.breakerMinRequests, resilience.breakerFailureRatio,
+              std::chrono::milliseconds(resilience.breakerOpenMs)) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    client = std::make_unique<AsyncAIClient>();
+}
+
+AIService::~AIService() {
+    client.reset(); // joins the transfer thread before libcurl is torn down
+    curl_global_cleanup();
+}
+
+static void countIfAttached(Counter* counter) {
+    if (counter) counter->add();
+}
+
+void AIService::attachMetrics(MetricsRegistry& metrics) {
+    const std::string latencyHelp = "Duration of one Gemini HTTP attempt";
+    geminiSuccessLatency = &metrics.histogram("medicare_gemini_request_duration_seconds", latencyHelp, "outcome=\"ok\"");
+    geminiFailureLatency = &metrics.histogram("medicare_gemini_request_duration_seconds", latencyHelp, "outcome=\"error\"");
+    geminiRetries = &metrics.counter("medicare_gemini_retries_total", "Gemini attempts retried after a failure");
+    geminiHedges = &metrics.counter("medicare_gemini_hedges_total", "Duplicate Gemini calls sent past the p95");
+    const std::string rejectHelp = "Gemini calls not made";
+    geminiBreakerRejections = &metrics.counter("medicare_gemini_rejected_total", rejectHelp, "reason=\"breaker_open\"");
+    geminiDeadlineRejections = &metrics.counter("medicare_gemini_rejected_total", rejectHelp, "reason=\"deadline\"");
+    metrics.callback("medicare_gemini_breaker_state", "Circuit breaker state: 0 closed, 1 open, 2 half-open", "gauge",
+                     [this]() { return static_cast<double>(breaker.getState()); });
+}
+
+struct GeminiAttempt {
+    GeminiReply reply;
+    GeminiReplyParser handler;
+    JsonStreamParser parser;
+    AIHttpResult result;
+    bool parsed = false; // transfer succeeded and the body was complete JSON
+    bool done = false;
+    AsyncAIClient::CancelToken cancel = std::make_shared<std::atomic<bool>>(false);
+
+    explicit GeminiAttempt(AIService::TextCallback onText) : handler(reply, std::move(onText)), parser(handler) {}
+};
+
+std::unique_ptr<GeminiAttempt> AIService::sendAttempt(const std::string& url, const std::string& payload,
+                                                      long timeoutMs, std::optional<double> hedgeAfterMs,
+                                                      const TextCallback& onText) {
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<std::unique_ptr<GeminiAttempt>> attempts; // this thread only; callbacks hold raw pointers
+
+    auto launch = [&](long timeout) {
+        attempts.push_back(std::make_unique<GeminiAttempt>(onText));
+        GeminiAttempt* attempt = attempts.back().get();
+        // Parse on the client thread as bytes arrive, so the reply is ready when the transfer ends
+        client->post(url, payload, timeout, [&, attempt](AIHttpResult result) {
+            bool parsed = result.ok && attempt->parser.finish();
+            std::lock_guard<std::mutex> lock(mutex);
+            attempt->result = std::move(result);
+            attempt->parsed = parsed;
+            attempt->done = true;
+            finished.notify_all();
+        }, [attempt](std::string_view bytes) {
+            attempt->parser.feed(bytes);
+        }, attempt->cancel);
+    };
+    auto winner = [&]() -> GeminiAttempt* {
+        for (auto& attempt : attempts) {
+            if (attempt->done && attempt->parsed) return attempt.get();
+        }
+        return nullptr;
+    };
+    auto allDone = [&]() {
+        return std::all_of(attempts.begin(), attempts.end(), [](const auto& attempt) { return attempt->done; });
+    };
+
+    auto startedAt = std::chrono::steady_clock::now();
+    launch(timeoutMs);
+    std::unique_lock<std::mutex> lock(mutex);
+    if (hedgeAfterMs && !finished.wait_for(lock, std::chrono::duration<double, std::milli>(*hedgeAfterMs), allDone)) {
+        // Slower than almost every recent call: race a duplicate instead of waiting on a straggler
+        long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startedAt).count();
+        if (timeoutMs - elapsedMs >= resilience.minAttemptMs) {
+            countIfAttached(geminiHedges);
+            lock.unlock();
+            launch(timeoutMs - elapsedMs);
+            lock.lock();
+        }
+    }
+    finished.wait(lock, [&]() { return winner() != nullptr || allDone(); });
+
+    // The callbacks reference this frame, so losers are cancelled and waited for before returning
+    GeminiAttempt* chosen = winner();
+    for (auto& attempt : attempts) {
+        if (!attempt->done) client->cancel(attempt->cancel);
+    }
+    finished.wait(lock, allDone);
+
+    for (auto& attempt : attempts) {
+        if (attempt.get() == chosen) return std::move(attempt);
+    }
+    return std::move(attempts.front());
+}
+
+bool AIService::requestGemini(const std::string& url, const std::string& payload, GeminiReply& reply,
+                              std::string& rawBody, TextCallback onText, Deadline deadline) {
+    // Text already shown to the user cannot be taken back, so a stream that has started is never retried
+    std::atomic<bool> textSent(false);
+    TextCallback forward;
+    if (onText) {
+        forward = [&](std::string_view text) {
+            textSent = true;
+            onText(text);
+        };
+    }
+
+    thread_local std::mt19937 random(std::random_device{}());
+    for (int attemptNumber = 1; ; ++attemptNumber) {
+        long remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remainingMs < resilience.minAttemptMs) {
+            countIfAttached(geminiDeadlineRejections);
+            std::cerr << "Gemini request skipped: the analysis deadline has passed" << std::endl;
+            return false;
+        }
+        if (!breaker.allowRequest()) { // open breaker: straight to the fallback
+            countIfAttached(geminiBreakerRejections);
+            return false;
+        }
+
+        // Hedging would interleave two streams, so only buffered calls are hedged
+        std::optional<double> hedgeAfterMs;
+        if (resilience.hedgeRequests && !onText) {
+            hedgeAfterMs = latencies.percentile(0.95, resilience.hedgeMinSamples);
+        }
+        auto attempt = sendAttempt(url, payload, std::min(requestTimeoutMs, remainingMs), hedgeAfterMs, forward);
+        const AIHttpResult& result = attempt->result;
+        breaker.record(attempt->parsed);
+        Histogram* latency = attempt->parsed ? geminiSuccessLatency : geminiFailureLatency;
+        if (latency) latency->record(static_cast<uint64_t>(result.elapsedMs * 1000));
+        reply = std::move(attempt->reply);
+        rawBody = std::move(attempt->result.body);
+        if (attempt->parsed) {
+            latencies.add(result.elapsedMs);
+            return true;
+        }
+
+        if (!result.ok) {
+            std::cerr << "Gemini request failed (attempt " << attemptNumber << "): " << result.error
+                      << (reply.apiError.empty() ? "" : " (" + reply.apiError + ")") << std::endl;
+        } else {
+            std::cerr << "Gemini reply is not valid JSON: " << attempt->parser.getError() << std::endl;
+        }
+        // Transport errors, throttling and server errors may pass; anything else will fail the same way again
+        bool retryable = !result.ok && (result.httpStatus == 0 || result.httpStatus == 429 || result.httpStatus >= 500);
+        if (!retryable || textSent || attemptNumber >= resilience.maxAttempts) return false;
+
+        // Full jitter keeps a burst of failed requests from retrying in lockstep
+        long ceilingMs = resilience.retryBaseDelayMs << std::min(attemptNumber - 1, 10);
+        auto backoff = std::chrono::milliseconds(std::uniform_int_distribution<long>(0, ceilingMs)(random));
+        if (std::chrono::steady_clock::now() + backoff + std::chrono::milliseconds(resilience.minAttemptMs) > deadline) {
+            return false;
+        }
+        countIfAttached(geminiRetries);
+        std::this_thread::sleep_for(backoff);
+    }
+}
+
+std::unique_ptr<SymptomAnalysis> AIService::analyzeSymptoms(const std::string& symptoms, 
+                                                          const std::string& duration, 
+                                                          int severity, Deadline deadline) {
+    return runAnalysis(symptoms, duration, severity, false, nullptr, deadline);
+}
+
+std::unique_ptr<SymptomAnalysis> AIService::streamSymptoms(const std::string& symptoms,
+                                                         const std::string& duration,
+                                                         int severity, TextCallback onText, Deadline deadline) {
+    return runAnalysis(symptoms, duration, severity, true, std::move(onText), deadline);
+}
+
+std::unique_ptr<SymptomAnalysis> AIService::runAnalysis(const std::string& symptoms, const std::string& duration,
+                                                      int severity, bool stream, TextCallback onText,
+                                                      Deadline deadline) {
+    auto analysis = std::make_unique<SymptomAnalysis>(symptoms, duration, severity);
+    
+    // Only the user's fields are escaped per request; the rest of the body was serialized at startup
+    std::string payload = payloadBuilder.build(symptoms, duration, severity);
+    
+    // The streaming endpoint answers with a JSON array of partial replies, which the parser reads as it arrives
+    std::string url = baseUrl + (stream ? ":streamGenerateContent" : ":generateContent") + "?key=" + apiKey;
+    GeminiReply reply;
+    std::string rawBody;
+    if (requestGemini(url, payload, reply, rawBody, onText, deadline)) {
+        analysis->setTokenUsage(reply.promptTokens, reply.candidateTokens);
+        analysis->setAnswerSource(SymptomAnalysis::AnswerSource::Gemini);
+    } else if (!reply.text.empty()) {
+        // Part of the answer arrived (and may already be on the page); don't present it as complete
+        static const std::string interrupted = "\n\n*The AI answer was interrupted before it finished.*";
+        reply.text += interrupted;
+        if (onText) onText(interrupted);
+    }
+    analysis->setMainAIText(std::move(reply.text)); // Store the extracted main AI text
+    analysis->setRawAIResponse(std::move(rawBody)); // Store the raw AI response
+    addAssessment(*analysis, symptoms);
+    return analysis;
+}
+
+void AIService::addAssessment(SymptomAnalysis& analysis, const std::string& symptoms) const {
+    auto hasCondition = [&](const std::string& name) {
+        for (const auto& condition : analysis.getPossibleConditions()) {
+            if (condition.condition == name) return true;
+        }
+        return false;
+    };
+    auto addSpecialty = [&](std::string specialty) {
+        const auto& existing = analysis.getSuggestedSpecialties();
+        if (std::find(existing.begin(), existing.end(), specialty) == existing.end()) {
+            analysis.addSuggestedSpecialty(std::move(specialty));
+        }
+    };
+
+    // One pass over the patient's words and the AI answer scores every rule in the table
+    if (classifier) {
+        SymptomClassifier::Classification matches = classifier->classify(symptoms, analysis.getMainAIText());
+        for (const auto& match : matches.conditions) {
+            if (hasCondition(match.rule->condition)) continue;
+            analysis.addCondition(match.rule->condition, match.rule->description, match.confidence);
+        }
+        for (auto& specialty : matches.specialties) {
+            addSpecialty(std::move(specialty.first));
+        }
+    }
+    
+    // Add general recommendations
+    analysis.addRecommendation("Consult with a healthcare professional for proper diagnosis");
+    analysis.addRecommendation("Monitor symptoms closely and note any changes");
+    analysis.addRecommendation("Rest and stay hydrated");
+    analysis.addRecommendation("Take over-the-counter medication if needed for symptom relief");
+    
+    // Add warning signs
+    analysis.addWarningSign("Difficulty breathing or shortness of breath");
+    analysis.addWarningSign("Severe or worsening pain");
+    analysis.addWarningSign("High fever above 102°F");
+    analysis.addWarningSign("Loss of consciousness or confusion");
+    
+    // Default fallback if no specific conditions were added
+    if (analysis.getSuggestedSpecialties().empty()) {
+        analysis.addCondition("General Medical Assessment", "Symptoms require professional medical evaluation", 75);
+        analysis.addSuggestedSpecialty("Internal Medicine");
+        analysis.addSuggestedSpecialty("Family Medicine");
+    }
+}
+
+// HybridAIService implementation
+HybridAIService::HybridAIService(const std::string& key, const std::string& baseUrl,
+                                 const GeminiPromptOptions& promptOptions,
+                                 std::shared_ptr<const SymptomClassifier> classifier, long requestTimeoutMs,
+                                 const GeminiResilienceOptions& resilience,
+                                 std::shared_ptr<const TriageModel> model, double fastPathProbability)
+    : AIService(key, baseUrl, promptOptions, std::move(classifier), requestTimeoutMs, resilience),
+      model(std::move(model)), fastPathProbability(fastPathProbability) {}
+
+void HybridAIService::attachMetrics(MetricsRegistry& metrics) {
+    AIService::attachMetrics(metrics);
+    const std::string help = "Analyses answered by the offline triage model";
+    fastPathAnswers = &metrics.counter("medicare_triage_answers_total", help, "path=\"fast\"");
+    fallbackAnswers = &metrics.counter("medicare_triage_answers_total", help, "path=\"fallback\"");
+}
+
+std::unique_ptr<SymptomAnalysis> HybridAIService::localAnalysis(const std::string& symptoms,
+                                                                const std::string& duration, int severity,
+                                                                const TriageModel::Prediction& prediction,
+                                                                bool fallback, std::string answerPrefix) const {
+    auto analysis = std::make_unique<SymptomAnalysis>(symptoms, duration, severity);
+    const TriageModel::Label& label = *prediction.label;
+    int confidence = std::min(95, static_cast<int>(prediction.probability * 100 + 0.5));
+
+    std::string& text = answerPrefix;
+    if (!text.empty()) text += "\n\n";
+    text += "**Quick triage:** your symptoms most resemble **" + label.condition + "** (" +
+            std::to_string(confidence) + "% model confidence). " + label.description + "\n\n" + label.advice + "\n\n";
+    text += fallback ? "*The AI assistant could not be reached, so this assessment comes from MediCare's offline triage model.*"
+                     : "*This assessment comes from MediCare's offline triage model.*";
+    analysis->setMainAIText(std::move(text));
+    analysis->setAnswerSource(fallback ? SymptomAnalysis::AnswerSource::TriageFallback
+                                       : SymptomAnalysis::AnswerSource::TriageModel);
+    countIfAttached(fallback ? fallbackAnswers : fastPathAnswers);
+
+    analysis->addCondition(label.condition, label.description, confidence);
+    for (const std::string& specialty : label.specialties) {
+        analysis->addSuggestedSpecialty(specialty);
+    }
+    addAssessment(*analysis, symptoms);
+    return analysis;
+}
+
+std::unique_ptr<SymptomAnalysis> HybridAIService::analyzeSymptoms(const std::string& symptoms,
+                                                                  const std::string& duration, int severity,
+                                                                  Deadline deadline) {
+    TriageModel::Prediction prediction = model->predict(symptoms);
+    if (prediction.probability >= fastPathProbability) {
+        return localAnalysis(symptoms, duration, severity, prediction, false, "");
+    }
+    auto analysis = AIService::analyzeSymptoms(symptoms, duration, severity, deadline);
+    if (analysis->getAnswerSource() == SymptomAnalysis::AnswerSource::Gemini) return analysis;
+    return localAnalysis(symptoms, duration, severity, prediction, true, "");
+}
+
+std::unique_ptr<SymptomAnalysis> HybridAIService::streamSymptoms(const std::string& symptoms,
+                                                                 const std::string& duration, int severity,
+                                                                 TextCallback onText, Deadline deadline) {
+    TriageModel::Prediction prediction = model->predict(symptoms);
+    bool fastPath = prediction.probability >= fastPathProbability;
+    std::unique_ptr<SymptomAnalysis> analysis;
+    if (!fastPath) {
+        analysis = AIService::streamSymptoms(symptoms, duration, severity, onText, deadline);
+        if (analysis->getAnswerSource() == SymptomAnalysis::AnswerSource::Gemini) return analysis;
+    }
+
+    // Whatever Gemini managed to stream before failing is already on the page; continue after it
+    std::string streamed = analysis ? analysis->getMainAIText() : std::string();
+    auto local = localAnalysis(symptoms, duration, severity, prediction, !fastPath, streamed);
+    onText(std::string_view(local->getMainAIText()).substr(streamed.size()));
+    return local;
+}
+
+// HttpServer implementation
+// AnalysisCache implementation
+AnalysisCache::AnalysisCache(size_t capacity, std::chrono::seconds ttl)
+    : capacity(capacity), ttl(ttl), hits(0), misses(0), coalesced(0) {}
+
+static void appendNormalized(std::string& key, const std::string& text) {
+    // Lowercase, punctuation folded to spaces, runs of whitespace collapsed
+    bool pendingSpace = false;
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c >= 0x80) {
+            if (pendingSpace && !key.empty() && key.back() != '|') key += ' ';
+            key += static_cast<char>(std::tolower(c));
+            pendingSpace = false;
+        } else {
+            pendingSpace = true;
+        }
+    }
+}
+
+std::string AnalysisCache::makeKey(const std::string& symptoms, const std::string& duration, int severity) {
+    std::string key;
+    key.reserve(symptoms.size() + duration.size() + 8);
+    appendNormalized(key, symptoms);
+    key += '|';
+    appendNormalized(key, duration);
+    key += '|';
+    key += std::to_string(std::max(1, std::min(10, severity)));
+    return key;
+}
+
+void AnalysisCache::insert(const std::string& key, const AnalysisPtr& value) {
+    auto existing = index.find(key);
+    if (existing != index.end()) {
+        entries.erase(existing->second);
+        index.erase(existing);
+    }
+    entries.push_front({key, value, std::chrono::steady_clock::now() + ttl});
+    index[key] = entries.begin();
+    while (entries.size() > capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+AnalysisCache::AnalysisPtr AnalysisCache::getOrCompute(const std::string& symptoms, const std::string& duration,
+                                                       int severity, const Loader& loader) {
+    if (capacity == 0) {
+        misses++;
+        return AnalysisPtr(loader());
+    }
+
+    std::string key = makeKey(symptoms, duration, severity);
+    std::promise<AnalysisPtr> promise;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            if (it->second->expiresAt > std::chrono::steady_clock::now()) {
+                entries.splice(entries.begin(), entries, it->second);
+                hits++;
+                return it->second->value;
+            }
+            entries.erase(it->second);
+            index.erase(it);
+        }
+
+        auto pending = inFlight.find(key);
+        if (pending != inFlight.end()) {
+            std::shared_future<AnalysisPtr> future = pending->second;
+            lock.unlock();
+            coalesced++;
+            return future.get();
+        }
+        inFlight.emplace(key, promise.get_future().share());
+        misses++;
+    }
+
+    AnalysisPtr result;
+    try {
+        result = AnalysisPtr(loader());
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.erase(key);
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.erase(key);
+        // Stand-in answers mean the upstream call failed; let the next request retry
+        if (result && !result->isDegraded()) {
+            insert(key, result);
+        }
+    }
+    promise.set_value(result);
+    return result;
+}
+
+size_t AnalysisCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+// HttpRequest implementation
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string_view trimView(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+std::string_view HttpRequest::getPath() const {
+    std::string_view target = getTarget();
+    return target.substr(0, target.find('?'));
+}
+
+std::string_view HttpRequest::getQuery() const {
+    std::string_view target = getTarget();
+    size_t mark = target.find('?');
+    return mark == std::string_view::npos ? std::string_view() : target.substr(mark + 1);
+}
+
+std::string_view HttpRequest::findHeader(std::string_view base, std::string_view name) const {
+    for (const auto& header : headerSpans) {
+        if (equalsIgnoreCase(base.substr(header.first.offset, header.first.length), name)) {
+            return base.substr(header.second.offset, header.second.length);
+        }
+    }
+    return std::string_view();
+}
+
+bool HttpRequest::findHeaderToken(std::string_view base, std::string_view name, std::string_view token) const {
+    // Comma-separated list headers such as Connection or Transfer-Encoding
+    for (const auto& header : headerSpans) {
+        if (!equalsIgnoreCase(base.substr(header.first.offset, header.first.length), name)) continue;
+        std::string_view value = base.substr(header.second.offset, header.second.length);
+        while (!value.empty()) {
+            size_t comma = value.find(',');
+            if (equalsIgnoreCase(trimView(value.substr(0, comma)), token)) return true;
+            if (comma == std::string_view::npos) break;
+            value.remove_prefix(comma + 1);
+        }
+    }
+    return false;
+}
+
+std::string_view HttpRequest::getHeader(std::string_view name) const {
+    return findHeader(raw, name);
+}
+
+bool HttpRequest::hasHeaderToken(std::string_view name, std::string_view token) const {
+    return findHeaderToken(raw, name, token);
+}
+
+bool HttpRequest::wantsKeepAlive() const {
+    if (hasHeaderToken("Connection", "close")) return false;
+    if (hasHeaderToken("Connection", "keep-alive")) return true;
+    return getVersion() == "HTTP/1.1";
+}
+
+// FormData implementation
+
+// Hex digit values, -1 for anything else; avoids a substr and std::stoi per escape
+static const std::array<int8_t, 256> HexDigitValues = []() {
+    std::array<int8_t, 256> table;
+    table.fill(-1);
+    for (int i = 0; i < 10; ++i) table['0' + i] = static_cast<int8_t>(i);
+    for (int i = 0; i < 6; ++i) {
+        table['a' + i] = static_cast<int8_t>(10 + i);
+        table['A' + i] = static_cast<int8_t>(10 + i);
+    }
+    return table;
+}();
+
+void FormData::decode(std::string_view encoded, std::string& out) {
+    // Write straight into the grown buffer, then trim; decoding never produces more bytes than it reads
+    size_t start = out.size();
+    out.resize(start + encoded.size());
+    char* write = &out[start];
+    const char* read = encoded.data();
+    const char* end = read + encoded.size();
+    while (read < end) {
+        char c = *read;
+        if (c == '+') {
+            *write++ = ' ';
+            ++read;
+        } else if (c == '%' && end - read > 2 && HexDigitValues[static_cast<unsigned char>(read[1])] >= 0 &&
+                   HexDigitValues[static_cast<unsigned char>(read[2])] >= 0) {
+            *write++ = static_cast<char>(HexDigitValues[static_cast<unsigned char>(read[1])] << 4 |
+                                         HexDigitValues[static_cast<unsigned char>(read[2])]);
+            read += 3;
+        } else {
+            *write++ = c; // includes a malformed '%', kept as typed
+            ++read;
+        }
+    }
+    out.resize(write - out.data());
+}
+
+FormData::FormData(std::string_view encoded) {
+    decoded.reserve(encoded.size()); // decoding never grows the text, so one allocation covers it
+    fields.reserve(std::count(encoded.begin(), encoded.end(), '&') + 1);
+
+    while (!encoded.empty()) {
+        size_t amp = encoded.find('&');
+        std::string_view pair = encoded.substr(0, amp);
+        encoded.remove_prefix(amp == std::string_view::npos ? encoded.size() : amp + 1);
+        if (pair.empty()) continue;
+
+        size_t equals = pair.find('=');
+        Span key, value;
+        key.offset = decoded.size();
+        decode(pair.substr(0, equals), decoded);
+        key.length = decoded.size() - key.offset;
+        value.offset = decoded.size();
+        if (equals != std::string_view::npos) decode(pair.substr(equals + 1), decoded);
+        value.length = decoded.size() - value.offset;
+        fields.emplace_back(key, value);
+    }
+}
+
+std::string_view FormData::get(std::string_view key) const {
+    for (const auto& field : fields) {
+        if (view(field.first) == key) return view(field.second);
+    }
+    return std::string_view();
+}
+
+bool FormData::has(std::string_view key) const {
+    for (const auto& field : fields) {
+        if (view(field.first) == key) return true;
+    }
+    return false;
+}
+
+void FormData::add(std::string_view key, std::string_view value) {
+    Span keySpan{decoded.size(), key.size()};
+    decoded.append(key);
+    Span valueSpan{decoded.size(), value.size()};
+    decoded.append(value);
+    fields.emplace_back(keySpan, valueSpan);
+}
+
+// Value of a parameter in a header such as Content-Disposition; quotes are stripped
+static std::optional<std::string_view> headerParameter(std::string_view header, std::string_view name) {
+    size_t pos = 0;
+    while ((pos = header.find(';', pos)) != std::string_view::npos) {
+        std::string_view rest = trimView(header.substr(pos + 1));
+        pos++;
+        if (rest.size() <= name.size() || rest[name.size()] != '=' ||
+            !equalsIgnoreCase(rest.substr(0, name.size()), name)) {
+            continue;
+        }
+        std::string_view value = rest.substr(name.size() + 1);
+        if (!value.empty() && value.front() == '"') {
+            size_t close = value.find('"', 1);
+            return value.substr(1, close == std::string_view::npos ? std::string_view::npos : close - 1);
+        }
+        return value.substr(0, value.find(';'));
+    }
+    return std::nullopt; // absent, as opposed to present but empty
+}
+
+bool FormData::parseMultipart(std::string_view body, std::string_view boundary, FormData& form) {
+    if (boundary.empty()) return false;
+    std::string delimiter = "--" + std::string(boundary);
+    size_t pos = body.find(delimiter);
+    if (pos == std::string_view::npos || pos + delimiter.size() + 2 > body.size()) return false;
+    pos += delimiter.size();
+
+    // Each part: CRLF, headers, blank line, content, CRLF--boundary; "--" after the boundary ends the body
+    std::string next = "\r\n" + delimiter;
+    while (body.compare(pos, 2, "--") != 0) {
+        if (body.compare(pos, 2, "\r\n") != 0) return false;
+        // A part without headers has its blank line right away; searching past it would read content as headers
+        size_t headersStart = pos + 2;
+        size_t headersEnd = body.compare(headersStart, 2, "\r\n") == 0 ? headersStart
+                                                                        : body.find("\r\n\r\n", headersStart);
+        if (headersEnd == std::string_view::npos) return false;
+        size_t contentStart = headersEnd + (headersEnd == headersStart ? 2 : 4);
+        size_t contentEnd = body.find(next, contentStart);
+        if (contentEnd == std::string_view::npos) return false;
+
+        std::string_view name;
+        bool hasFilename = false;
+        std::string_view headers = body.substr(headersStart, headersEnd - headersStart);
+        while (!headers.empty()) {
+            size_t lineEnd = headers.find("\r\n");
+            std::string_view line = headers.substr(0, lineEnd);
+            headers.remove_prefix(lineEnd == std::string_view::npos ? headers.size() : lineEnd + 2);
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos ||
+                !equalsIgnoreCase(trimView(line.substr(0, colon)), "Content-Disposition")) {
+                continue;
+            }
+            std::string_view disposition = line.substr(colon + 1);
+            name = headerParameter(disposition, "name").value_or(std::string_view());
+            hasFilename = headerParameter(disposition, "filename").has_value(); // filename="" is still a file part
+        }
+        if (!name.empty() && !hasFilename) {
+            form.add(name, body.substr(contentStart, contentEnd - contentStart));
+        }
+        pos = contentEnd + next.size();
+        if (pos + 2 > body.size()) return false;
+    }
+    return true;
+}
+
+// Collects the scalar members of record objects: the document itself, or the elements of a
+// top-level array or of an array member of the top-level object. Deeper values are skipped.
+// A top-level object with scalar members of its own is a single record; see parseJson.
+class JsonRecordCollector : public JsonStreamParser::Handler {
+private:
+    struct Level {
+        char kind;   // '{' or '['
+        long record; // index into records, -1 when members are not collected
+    };
+
+    std::vector<FormData>& records;
+    std::vector<Level> open;
+    std::string pendingKey;
+    bool haveKey = false;
+
+    void scalar(std::string_view value) {
+        if (haveKey && !open.empty() && open.back().record >= 0) records[open.back().record].add(pendingKey, value);
+        haveKey = false;
+    }
+
+public:
+    bool documentIsObject = false;
+
+    explicit JsonRecordCollector(std::vector<FormData>& records) : records(records) {}
+
+    void startObject() override {
+        haveKey = false;
+        if (open.empty()) documentIsObject = true;
+        bool isRecord = open.empty() || (open.size() == 1 && open[0].kind == '[') ||
+                        (open.size() == 2 && open[0].kind == '{' && open[1].kind == '[');
+        open.push_back({'{', isRecord ? static_cast<long>(records.size()) : -1});
+        if (isRecord) records.emplace_back();
+    }
+    void endObject() override { open.pop_back(); }
+    void startArray() override {
+        haveKey = false;
+        open.push_back({'[', -1});
+    }
+    void endArray() override { open.pop_back(); }
+    void key(std::string_view name) override {
+        pendingKey.assign(name);
+        haveKey = true;
+    }
+    void stringValue(std::string_view value) override { scalar(value); }
+    void numberValue(std::string_view value) override { scalar(value); }
+    void literalValue(std::string_view value) override {
+        if (value == "null") haveKey = false; // same as leaving the member out
+        else scalar(value);
+    }
+};
+
+bool FormData::parseJson(std::string_view body, std::vector<FormData>& records, std::string& error) {
+    std::vector<FormData> collected;
+    JsonRecordCollector collector(collected);
+    JsonStreamParser parser(collector);
+    if (!parser.feed(body) || !parser.finish()) {
+        error = parser.failed() ? parser.getError() : "incomplete JSON document";
+        return false;
+    }
+    if (collector.documentIsObject && collected.front().size() > 0) {
+        records.push_back(std::move(collected.front()));
+        return true;
+    }
+    for (FormData& record : collected) {
+        if (record.size() > 0) records.push_back(std::move(record));
+    }
+    return true;
+}
+
+// HttpRequestParser implementation
+HttpRequestParser::HttpRequestParser(const HttpParserLimits& limits) : limits(limits) {
+    reset();
+}
+
+void HttpRequestParser::reset() {
+    state = State::RequestLine;
+    current = HttpRequest();
+    position = 0;
+    headerBytes = 0;
+    bodyStart = 0;
+    bodyLength = 0;
+    chunkRemaining = 0;
+    errorStatus = 0;
+    expectContinue = false;
+    continueSent = false;
+}
+
+HttpRequestParser::Status HttpRequestParser::fail(int status) {
+    errorStatus = status;
+    return Status::Error;
+}
+
+bool HttpRequestParser::nextLine(const std::string& buffer, std::string_view& line, size_t& lineStart,
+                                 size_t limit, int overflowStatus, Status& status) {
+    size_t end = buffer.find('\n', position);
+    if (end == std::string::npos) {
+        status = buffer.size() - position > limit ? fail(overflowStatus) : Status::NeedMore;
+        return false;
+    }
+    if (end - position > limit) {
+        status = fail(overflowStatus);
+        return false;
+    }
+    lineStart = position;
+    line = std::string_view(buffer).substr(position, end - position);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    position = end + 1;
+    return true;
+}
+
+bool HttpRequestParser::needsContinue() const {
+    return expectContinue && !continueSent &&
+           (state == State::Body || state == State::ChunkSize || state == State::ChunkData);
+}
+
+HttpRequestParser::Status HttpRequestParser::beginBody(const std::string& buffer) {
+    bodyStart = position;
+    current.bodySpan = {bodyStart, 0};
+    expectContinue = current.findHeaderToken(buffer, "Expect", "100-continue");
+
+    std::string_view transferEncoding = current.findHeader(buffer, "Transfer-Encoding");
+    if (!transferEncoding.empty()) {
+        if (!current.findHeaderToken(buffer, "Transfer-Encoding", "chunked")) return fail(501);
+        if (!current.findHeader(buffer, "Content-Length").empty()) return fail(400);
+        bodyLength = 0;
+        state = State::ChunkSize;
+        return Status::NeedMore;
+    }
+
+    std::string_view contentLength = current.findHeader(buffer, "Content-Length");
+    if (contentLength.empty()) {
+        state = State::Done;
+        return Status::Complete;
+    }
+
+    size_t length = 0;
+    for (char c : contentLength) {
+        if (c < '0' || c > '9') return fail(400);
+        if (length > (limits.maxBodyBytes + 9) / 10) return fail(413);
+        length = length * 10 + (c - '0');
+    }
+    if (length > limits.maxBodyBytes) return fail(413);
+
+    bodyLength = length;
+    state = State::Body;
+    return Status::NeedMore;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse(std::string& buffer) {
+    Status status = Status::NeedMore;
+    std::string_view line;
+    size_t lineStart = 0;
+
+    for (;;) {
+        switch (state) {
+        case State::RequestLine: {
+            if (!nextLine(buffer, line, lineStart, limits.maxRequestLineBytes, 414, status)) return status;
+            if (line.empty()) continue; // tolerate stray CRLF between pipelined requests
+
+            size_t firstSpace = line.find(' ');
+            size_t secondSpace = firstSpace == std::string_view::npos ? firstSpace : line.find(' ', firstSpace + 1);
+            if (firstSpace == 0 || secondSpace == std::string_view::npos || secondSpace == firstSpace + 1) {
+                return fail(400);
+            }
+            current.methodSpan = {lineStart, firstSpace};
+            current.targetSpan = {lineStart + firstSpace + 1, secondSpace - firstSpace - 1};
+            current.versionSpan = {lineStart + secondSpace + 1, line.size() - secondSpace - 1};
+
+            std::string_view version = line.substr(secondSpace + 1);
+            if (version.substr(0, 5) != "HTTP/") return fail(400);
+            if (version != "HTTP/1.1" && version != "HTTP/1.0") return fail(505);
+            state = State::Headers;
+            break;
+        }
+
+        case State::Headers: {
+            size_t remaining = limits.maxHeaderBytes - std::min(headerBytes, limits.maxHeaderBytes);
+            if (!nextLine(buffer, line, lineStart, remaining, 431, status)) return status;
+            headerBytes += line.size() + 2;
+
+            if (line.empty()) {
+                status = beginBody(buffer);
+                if (status != Status::NeedMore) return status;
+                break;
+            }
+            if (line.front() == ' ' || line.front() == '\t') return fail(400); // obsolete line folding
+            if (current.headerSpans.size() >= limits.maxHeaderCount) return fail(431);
+
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos || colon == 0) return fail(400);
+            std::string_view value = trimView(line.substr(colon + 1));
+            size_t valueStart = value.empty() ? lineStart + colon + 1 : value.data() - buffer.data();
+            current.headerSpans.push_back({{lineStart, colon}, {valueStart, value.size()}});
+            break;
+        }
+
+        case State::Body:
+            if (buffer.size() - bodyStart < bodyLength) return Status::NeedMore;
+            current.bodySpan = {bodyStart, bodyLength};
+            position = bodyStart + bodyLength;
+            state = State::Done;
+            return Status::Complete;
+
+        case State::ChunkSize: {
+            if (!nextLine(buffer, line, lineStart, limits.maxRequestLineBytes, 400, status)) return status;
+            line = line.substr(0, line.find(';')); // chunk extensions are ignored
+            line = trimView(line);
+            if (line.empty()) return fail(400);
+
+            size_t size = 0;
+            for (char c : line) {
+                int digit = std::isdigit(static_cast<unsigned char>(c)) ? c - '0'
+                          : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                          : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                if (digit < 0) return fail(400);
+                if (size > limits.maxBodyBytes) return fail(413);
+                size = size * 16 + digit;
+            }
+            if (bodyLength + size > limits.maxBodyBytes) return fail(413);
+
+            chunkRemaining = size;
+            state = size == 0 ? State::Trailers : State::ChunkData;
+            break;
+        }
+
+        case State::ChunkData: {
+            if (buffer.size() - position < chunkRemaining + 2) {
+                // Cap what a client can make us buffer for one chunk
+                return buffer.size() - position > limits.maxBodyBytes + 2 ? fail(413) : Status::NeedMore;
+            }
+            if (buffer[position + chunkRemaining] == '\r') {
+                if (buffer[position + chunkRemaining + 1] != '\n') return fail(400);
+            } else if (buffer[position + chunkRemaining] != '\n') {
+                return fail(400);
+            }
+
+            // Compact chunk payloads into one contiguous body; decoded bytes never overtake the input
+            std::memmove(&buffer[bodyStart + bodyLength], &buffer[position], chunkRemaining);
+            bodyLength += chunkRemaining;
+            position += chunkRemaining + (buffer[position + chunkRemaining] == '\r' ? 2 : 1);
+            chunkRemaining = 0;
+            state = State::ChunkSize;
+            break;
+        }
+
+        case State::Trailers: {
+            size_t remaining = limits.maxHeaderBytes - std::min(headerBytes, limits.maxHeaderBytes);
+            if (!nextLine(buffer, line, lineStart, remaining, 431, status)) return status;
+            headerBytes += line.size() + 2;
+            if (!line.empty()) break; // trailer fields are not used
+
+            current.bodySpan = {bodyStart, bodyLength};
+            state = State::Done;
+            return Status::Complete;
+        }
+
+        case State::Done:
+            return Status::Complete;
+        }
+    }
+}
+
+HttpRequest HttpRequestParser::takeRequest(std::string& buffer) {
+    HttpRequest request = std::move(current);
+    request.receivedAt = std::chrono::steady_clock::now();
+    if (position >= buffer.size()) {
+        request.raw.swap(buffer); // common case: the buffer holds exactly one request
+        buffer.clear();
+    } else {
+        request.raw.assign(buffer, 0, position);
+        buffer.erase(0, position);
+    }
+    reset();
+    return request;
+}
+
+// StaticAsset implementation
+static bool acceptsEncoding(std::string_view acceptEncoding, std::string_view encoding) {
+    // Honors explicit q=0 refusals; "*" covers anything not listed
+    bool wildcard = false;
+    while (!acceptEncoding.empty()) {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view item = trimView(acceptEncoding.substr(0, comma));
+        acceptEncoding.remove_prefix(comma == std::string_view::npos ? acceptEncoding.size() : comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view name = trimView(item.substr(0, semicolon));
+        bool refused = false;
+        if (semicolon != std::string_view::npos) {
+            std::string_view params = item.substr(semicolon + 1);
+            size_t q = params.find("q=");
+            refused = q != std::string_view::npos && std::strtod(std::string(params.substr(q + 2)).c_str(), nullptr) <= 0.0;
+        }
+        if (equalsIgnoreCase(name, encoding)) return !refused;
+        if (name == "*") wildcard = !refused;
+    }
+    return wildcard;
+}
+
+const StaticAssetVariant& StaticAsset::selectVariant(std::string_view acceptEncoding) const {
+    for (const auto& variant : variants) {
+        if (variant.encoding.empty() || acceptsEncoding(acceptEncoding, variant.encoding)) {
+            return variant;
+        }
+    }
+    return variants.back();
+}
+
+bool StaticAssetVariant::matchesEtag(std::string_view ifNoneMatch) const {
+    while (!ifNoneMatch.empty()) {
+        size_t comma = ifNoneMatch.find(',');
+        std::string_view tag = trimView(ifNoneMatch.substr(0, comma));
+        ifNoneMatch.remove_prefix(comma == std::string_view::npos ? ifNoneMatch.size() : comma + 1);
+
+        if (tag == "*") return true;
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2); // weak comparison is fine for GET
+        if (tag == etag) return true;
+    }
+    return false;
+}
+
+// StaticAssetCache implementation
+static bool gzipCompress(const std::string& input, std::string& output) {
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
+
+static bool brotliCompress(const std::string& input, std::string& output) {
+    size_t encodedSize = BrotliEncoderMaxCompressedSize(input.size());
+    if (encodedSize == 0) return false;
+    output.resize(encodedSize);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+                               &encodedSize, reinterpret_cast<uint8_t*>(&output[0]))) {
+        return false;
+    }
+    output.resize(encodedSize);
+    return true;
+}
+
+static std::string contentHash(const std::string& data) {
+    // FNV-1a, only used to derive ETags
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::build(const std::string& filePath, const std::string& contentType) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) return nullptr;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    auto identity = std::make_shared<const std::string>(buffer.str());
+
+    auto asset = std::make_shared<StaticAsset>();
+    asset->filePath = filePath;
+    asset->contentType = contentType;
+    std::string hash = contentHash(*identity);
+
+    auto addVariant = [&](const std::string& encoding, std::shared_ptr<const std::string> body) {
+        StaticAssetVariant variant;
+        variant.encoding = encoding;
+        variant.etag = "\"" + hash + (encoding.empty() ? "" : "-" + encoding) + "\"";
+        variant.head = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: " + contentType + "\r\n"
+                       "Content-Length: " + std::to_string(body->size()) + "\r\n" +
+                       (encoding.empty() ? "" : "Content-Encoding: " + encoding + "\r\n") +
+                       "ETag: " + variant.etag + "\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Vary: Accept-Encoding\r\n";
+        variant.body = std::move(body);
+        asset->variants.push_back(std::move(variant));
+    };
+
+    // Compressed variants are only kept when they actually save bytes
+    std::string compressed;
+    if (brotliCompress(*identity, compressed) && compressed.size() < identity->size()) {
+        addVariant("br", std::make_shared<const std::string>(std::move(compressed)));
+    }
+    compressed.clear();
+    if (gzipCompress(*identity, compressed) && compressed.size() < identity->size()) {
+        addVariant("gzip", std::make_shared<const std::string>(std::move(compressed)));
+    }
+    addVariant("", identity);
+    return asset;
+}
+
+bool StaticAssetCache::reload(const Source& source) {
+    auto asset = build(source.filePath, source.contentType);
+    if (!asset) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    assets[source.urlPath] = asset;
+    return true;
+}
+
+bool StaticAssetCache::add(const std::string& urlPath, const std::string& filePath, const std::string& contentType) {
+    Source source{urlPath, filePath, contentType};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sources.push_back(source);
+    }
+    return reload(source);
+}
+
+std::shared_ptr<const StaticAsset> StaticAssetCache::find(const std::string& urlPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = assets.find(urlPath);
+    return it == assets.end() ? nullptr : it->second;
+}
+
+static std::string directoryOf(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+}
+
+static std::string baseNameOf(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool StaticAssetCache::startWatching() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& source : sources) {
+            watcher.add(source.filePath, [this, source]() {
+                if (reload(source)) {
+                    std::cout << " Reloaded static asset " << source.filePath << std::endl;
+                }
+            });
+        }
+    }
+    return watcher.start();
+}
+
+void StaticAssetCache::stopWatching() {
+    watcher.stop();
+}
+
+// FileWatcher implementation
+FileWatcher::FileWatcher() : inotifyFd(-1), running(false) {}
+
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+void FileWatcher::add(const std::string& path, std::function<void()> onChange) {
+    watches.push_back(Watch{directoryOf(path), baseNameOf(path), std::move(onChange)});
+}
+
+bool FileWatcher::start() {
+    if (running) return true;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) return false;
+
+    for (const auto& watch : watches) {
+        bool known = false;
+        for (const auto& entry : directories) {
+            known = known || entry.second == watch.directory;
+        }
+        if (known) continue;
+        int wd = inotify_add_watch(inotifyFd, watch.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd >= 0) directories[wd] = watch.directory;
+    }
+
+    running = true;
+    thread = std::thread(&FileWatcher::watchLoop, this);
+    return true;
+}
+
+void FileWatcher::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    directories.clear();
+}
+
+void FileWatcher::watchLoop() {
+    alignas(inotify_event) char buffer[4096];
+    while (running) {
+        pollfd pfd{inotifyFd, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) continue;
+
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) continue;
+
+            auto directory = directories.find(event->wd);
+            if (directory == directories.end()) continue;
+
+            for (const auto& watch : watches) {
+                if (watch.directory == directory->second && watch.name == event->name) {
+                    watch.onChange();
+                }
+            }
+        }
+    }
+}
+
+// AppointmentJournal implementation
+static const uint32_t JournalMagic = 0x4A41434D; // "MCAJ" little-endian
+static const uint8_t JournalRecordVersion = 1;
+static const size_t JournalHeaderBytes = 12;
+static const uint32_t JournalMaxPayloadBytes = 1024 * 1024;
+
+static void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static uint32_t getU32(const char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+static void putString(std::string& out, const std::string& value) {
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+static bool getString(std::string_view& in, std::string& value) {
+    if (in.size() < 4) return false;
+    uint32_t length = getU32(in.data());
+    if (in.size() - 4 < length) return false;
+    value.assign(in.data() + 4, length);
+    in.remove_prefix(4 + length);
+    return true;
+}
+
+AppointmentJournal::AppointmentJournal(const std::string& path)
+    : path(path), fd(-1), stopping(false), writing(false), failed(false), recordCount(0), commitCount(0) {}
+
+AppointmentJournal::~AppointmentJournal() {
+    close();
+}
+
+void AppointmentJournal::attachMetrics(MetricsRegistry& metrics) {
+    commitLatency = &metrics.histogram("medicare_journal_commit_duration_seconds",
+                                       "Appointment journal group commit (writev and fdatasync)");
+    commitBatchSize = &metrics.histogram("medicare_journal_commit_records", "Appointments per group commit", "",
+                                         Histogram::Unit::Count);
+}
+
+std::string AppointmentJournal::encode(const Appointment& appointment) {
+    std::string payload;
+    payload += static_cast<char>(JournalRecordVersion);
+    putU32(payload, static_cast<uint32_t>(appointment.getId()));
+    putU32(payload, static_cast<uint32_t>(appointment.getDoctorId()));
+    putString(payload, appointment.getPatientName());
+    putString(payload, appointment.getPatientEmail());
+    putString(payload, appointment.getPatientPhone());
+    putString(payload, appointment.getAppointmentDate());
+    putString(payload, appointment.getAppointmentTime());
+    putString(payload, appointment.getAppointmentType());
+    putString(payload, appointment.getSymptoms());
+    putString(payload, appointment.getNotes());
+    putString(payload, appointment.getStatus());
+    return payload;
+}
+
+std::optional<Appointment> AppointmentJournal::decode(std::string_view payload) {
+    if (payload.size() < 9 || static_cast<uint8_t>(payload[0]) != JournalRecordVersion) return std::nullopt;
+    int id = static_cast<int>(getU32(payload.data() + 1));
+    int doctorId = static_cast<int>(getU32(payload.data() + 5));
+    payload.remove_prefix(9);
+
+    std::string fields[9];
+    for (auto& field : fields) {
+        if (!getString(payload, field)) return std::nullopt;
+    }
+    Appointment appointment(id, doctorId, std::move(fields[0]), std::move(fields[1]), std::move(fields[2]),
+                            std::move(fields[3]), std::move(fields[4]), std::move(fields[5]),
+                            std::move(fields[6]), std::move(fields[7]));
+    appointment.setStatus(std::move(fields[8]));
+    return appointment;
+}
+
+bool AppointmentJournal::open(std::vector<Appointment>& recovered) {
+    bool created = access(path.c_str(), F_OK) != 0;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        std::cerr << "Failed to open appointment journal " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    // One process writes the journal at a time; a hot-restarted server blocks here until the old one closes it
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cout << " Waiting for the previous server to release " << path << std::endl;
+        int locked;
+        while ((locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+        if (locked != 0) {
+            std::cerr << "Failed to lock appointment journal " << path << ": " << strerror(errno) << std::endl;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+    if (created) {
+        // Make the new directory entry itself durable
+        int dirFd = ::open(directoryOf(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            ::close(dirFd);
+        }
+    }
+
+    std::string contents;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = pread(fd, buffer, sizeof(buffer), contents.size())) > 0) {
+        contents.append(buffer, n);
+    }
+
+    size_t offset = 0;
+    while (contents.size() - offset >= JournalHeaderBytes) {
+        const char* header = contents.data() + offset;
+        uint32_t length = getU32(header + 4);
+        if (getU32(header) != JournalMagic || length > JournalMaxPayloadBytes ||
+            contents.size() - offset - JournalHeaderBytes < length) {
+            break;
+        }
+        const char* payload = header + JournalHeaderBytes;
+        uint32_t checksum = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(payload), length));
+        if (checksum != getU32(header + 8)) break;
+
+        auto appointment = decode(std::string_view(payload, length));
+        if (!appointment) break;
+        recovered.push_back(std::move(*appointment));
+        offset += JournalHeaderBytes + length;
+    }
+
+    if (offset < contents.size()) {
+        // A crash mid-append leaves a partial frame; drop it so new records stay readable
+        std::cerr << "Appointment journal: discarding " << (contents.size() - offset)
+                  << " bytes of torn or corrupt data after record " << recovered.size() << std::endl;
+        if (ftruncate(fd, offset) != 0 || fdatasync(fd) != 0) {
+            std::cerr << "Failed to truncate appointment journal: " << strerror(errno) << std::endl;
+        }
+    }
+    recordCount = recovered.size();
+
+    stopping = false;
+    writerThread = std::thread(&AppointmentJournal::writerLoop, this);
+    return true;
+}
+
+std::future<bool> AppointmentJournal::append(const Appointment& appointment) {
+    std::string payload = encode(appointment);
+    PendingRecord record;
+    record.frame.reserve(JournalHeaderBytes + payload.size());
+    putU32(record.frame, JournalMagic);
+    putU32(record.frame, static_cast<uint32_t>(payload.size()));
+    putU32(record.frame, static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(payload.data()), payload.size())));
+    record.frame += payload;
+
+    std::future<bool> future = record.durable.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0 || stopping || failed) {
+            record.durable.set_value(false);
+            return future;
+        }
+        queue.push_back(std::move(record));
+    }
+    condition.notify_one();
+    return future;
+}
+
+void AppointmentJournal::writerLoop() {
+    for (;;) {
+        std::deque<PendingRecord> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) break;
+            batch.swap(queue);
+            writing = true;
+        }
+
+        // Everything that queued up during the previous fdatasync shares this one
+        auto commitStarted = std::chrono::steady_clock::now();
+        off_t batchStart = lseek(fd, 0, SEEK_END); // we are the only writer (flock), so appends land here
+        std::vector<iovec> parts;
+        parts.reserve(batch.size());
+        for (auto& record : batch) {
+            parts.push_back({&record.frame[0], record.frame.size()});
+        }
+
+        bool ok = true;
+        size_t index = 0;
+        while (ok && index < parts.size()) {
+            int count = static_cast<int>(std::min<size_t>(parts.size() - index, IOV_MAX));
+            ssize_t n = writev(fd, &parts[index], count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            // Advance past fully written frames; finish a partially written one
+            while (n > 0 && index < parts.size()) {
+                if (static_cast<size_t>(n) >= parts[index].iov_len) {
+                    n -= parts[index].iov_len;
+                    ++index;
+                } else {
+                    parts[index].iov_base = static_cast<char*>(parts[index].iov_base) + n;
+                    parts[index].iov_len -= n;
+                    n = 0;
+                }
+            }
+        }
+        if (ok && fdatasync(fd) != 0) ok = false;
+        if (!ok) {
+            std::cerr << "Appointment journal write failed: " << strerror(errno) << std::endl;
+            // Cut the batch back out so the file holds exactly what the futures report; a torn
+            // frame left behind would make recovery discard every later commit
+            if (batchStart < 0 || ftruncate(fd, batchStart) != 0 || fdatasync(fd) != 0) {
+                std::cerr << "Appointment journal could not be rolled back (" << strerror(errno)
+                          << "); refusing further bookings" << std::endl;
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+            }
+        } else {
+            recordCount += batch.size();
+            commitCount++;
+            if (commitLatency) commitLatency->recordDuration(std::chrono::steady_clock::now() - commitStarted);
+            if (commitBatchSize) commitBatchSize->record(batch.size());
+        }
+
+        for (auto& record : batch) {
+            record.durable.set_value(ok);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing = false;
+        }
+        drained.notify_all();
+    }
+}
+
+void AppointmentJournal::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return queue.empty() && !writing; });
+}
+
+void AppointmentJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    if (writerThread.joinable()) writerThread.join(); // the writer drains the queue before exiting
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// DoctorRoster implementation
+static const uint32_t RosterMagic = 0x5352434D; // "MCRS" little-endian
+static const uint32_t RosterVersion = 1;
+
+int DoctorRecordView::getId() const { return static_cast<int>(getU32(record)); }
+int DoctorRecordView::getExperience() const { return static_cast<int>(getU32(record + 4)); }
+double DoctorRecordView::getRating() const { return getU32(record + 8) / 100.0; }
+int DoctorRecordView::getReviewCount() const { return static_cast<int>(getU32(record + 12)); }
+int DoctorRecordView::getConsultationFee() const { return static_cast<int>(getU32(record + 16)); }
+
+std::string_view DoctorRecordView::stringAt(size_t fieldOffset) const {
+    // Bounds were validated in DoctorRoster::open
+    return strings.substr(getU32(record + fieldOffset), getU32(record + fieldOffset + 4));
+}
+
+DoctorRoster::~DoctorRoster() {
+    if (mapping) munmap(mapping, mappingSize);
+}
+
+std::shared_ptr<const DoctorRoster> DoctorRoster::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = path + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(HeaderBytes)) {
+        ::close(fd);
+        error = path + ": truncated header";
+        return nullptr;
+    }
+
+    std::shared_ptr<DoctorRoster> roster(new DoctorRoster());
+    roster->mappingSize = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, roster->mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file contents alive, even across a rename
+    if (mapping == MAP_FAILED) {
+        error = path + ": mmap failed: " + strerror(errno);
+        return nullptr;
+    }
+    roster->mapping = mapping;
+
+    const char* base = static_cast<const char*>(mapping);
+    if (getU32(base) != RosterMagic || getU32(base + 4) != RosterVersion) {
+        error = path + ": not a version " + std::to_string(RosterVersion) + " roster";
+        return nullptr;
+    }
+    uint64_t count = getU32(base + 8);
+    uint64_t stringBytes = getU32(base + 12);
+    uint64_t stringOffset = HeaderBytes + count * RecordBytes;
+    if (stringOffset + stringBytes != roster->mappingSize) {
+        error = path + ": size does not match header";
+        return nullptr;
+    }
+    roster->recordCount = static_cast<uint32_t>(count);
+    roster->records = base + HeaderBytes;
+    roster->strings = std::string_view(base + stringOffset, stringBytes);
+
+    // Validate every string reference once so views never need to check
+    std::unordered_map<uint32_t, uint32_t> recordById;
+    for (uint32_t i = 0; i < roster->recordCount; ++i) {
+        const char* record = roster->records + static_cast<size_t>(i) * RecordBytes;
+        if (!recordById.emplace(getU32(record), i).second) {
+            error = path + ": record " + std::to_string(i) + " repeats doctor id " + std::to_string(getU32(record));
+            return nullptr;
+        }
+        for (size_t field = 20; field < RecordBytes; field += 8) {
+            uint64_t offset = getU32(record + field);
+            uint64_t length = getU32(record + field + 4);
+            if (offset + length > stringBytes) {
+                error = path + ": record " + std::to_string(i) + " has an out-of-range string";
+                return nullptr;
+            }
+        }
+    }
+    return roster;
+}
+
+// Whole-field decimal; atoi would turn "12a" or "" into a plausible number
+static bool parseRosterNumber(const std::string& text, uint32_t& value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    errno = 0;
+    char* end = nullptr;
+    unsigned long number = std::strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || number > INT_MAX) return false;
+    value = static_cast<uint32_t>(number);
+    return true;
+}
+
+bool DoctorRoster::compile(const std::string& tsvPath, const std::string& outputPath, std::string& error) {
+    std::ifstream input(tsvPath);
+    if (!input.is_open()) {
+        error = tsvPath + ": cannot open";
+        return false;
+    }
+
+    std::string records;
+    std::string strings;
+    uint32_t count = 0;
+    auto putRef = [&](const std::string& value) {
+        putU32(records, static_cast<uint32_t>(strings.size()));
+        putU32(records, static_cast<uint32_t>(value.size()));
+        strings += value;
+    };
+
+    std::unordered_map<uint32_t, int> lineById;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields = splitFields(line, '\t');
+        if (fields.size() != 10) {
+            error = tsvPath + ":" + std::to_string(lineNumber) + ": expected 10 fields, got " + std::to_string(fields.size());
+            return false;
+        }
+        std::string where = tsvPath + ":" + std::to_string(lineNumber) + ": ";
+        uint32_t id, experience, reviews, fee;
+        if (!parseRosterNumber(fields[0], id) || id == 0) {
+            error = where + "bad id";
+            return false;
+        }
+        auto seen = lineById.emplace(id, lineNumber);
+        if (!seen.second) {
+            error = where + "doctor id " + fields[0] + " already used on line " + std::to_string(seen.first->second);
+            return false;
+        }
+        if (!parseRosterNumber(fields[3], experience) || !parseRosterNumber(fields[5], reviews) ||
+            !parseRosterNumber(fields[6], fee)) {
+            error = where + "bad experience, review count or fee";
+            return false;
+        }
+        char* end = nullptr;
+        double rating = std::strtod(fields[4].c_str(), &end);
+        if (end == fields[4].c_str() || *end != '\0' || !(rating >= 0 && rating <= 5)) {
+            error = where + "bad rating";
+            return false;
+        }
+        putU32(records, id);
+        putU32(records, experience);
+        putU32(records, static_cast<uint32_t>(rating * 100 + 0.5));
+        putU32(records, reviews);
+        putU32(records, fee);
+        putRef(fields[1]); // name
+        putRef(fields[2]); // specialty
+        putRef(fields[9]); // bio
+        putRef(fields[7]); // image url
+        putRef(fields[8]); // specializations
+        ++count;
+    }
+    if (count == 0) {
+        // Usually a file caught mid-write; publishing it would empty the live directory
+        error = tsvPath + ": no doctors";
+        return false;
+    }
+
+    std::string header;
+    putU32(header, RosterMagic);
+    putU32(header, RosterVersion);
+    putU32(header, count);
+    putU32(header, static_cast<uint32_t>(strings.size()));
+
+    // Write beside the target and rename so a running server never maps a half-written file
+    std::string tempPath = outputPath + ".tmp";
+    {
+        std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+        output << header << records << strings;
+        if (!output.flush()) {
+            error = tempPath + ": write failed";
+            return false;
+        }
+    }
+    if (rename(tempPath.c_str(), outputPath.c_str()) != 0) {
+        error = outputPath + ": " + strerror(errno);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// AppointmentStore implementation
+AppointmentStore::AppointmentStore() : appointmentCount(0) {}
+
+bool AppointmentStore::parseDate(std::string_view date, int32_t& day) {
+    // YYYY-MM-DD, as submitted by <input type='date'>
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-') return false;
+    int parts[3] = {0, 0, 0};
+    const size_t starts[3] = {0, 5, 8};
+    const size_t lengths[3] = {4, 2, 2};
+    for (int i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < lengths[i]; ++j) {
+            char c = date[starts[i] + j];
+            if (c < '0' || c > '9') return false;
+            parts[i] = parts[i] * 10 + (c - '0');
+        }
+    }
+    int year = parts[0], month = parts[1], dayOfMonth = parts[2];
+    static const int monthDays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month < 1 || month > 12 || dayOfMonth < 1 ||
+        dayOfMonth > monthDays[month - 1] + (month == 2 && leap ? 1 : 0)) {
+        return false;
+    }
+
+    // Days from civil date (proleptic Gregorian)
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + dayOfMonth - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    day = era * 146097 + dayOfEra - 719468;
+    return true;
+}
+
+bool AppointmentStore::parseTime(std::string_view time, int& slot) {
+    // "9:00 AM" from the booking form, or 24-hour "14:30"
+    size_t colon = time.find(':');
+    if (colon == std::string_view::npos || colon == 0 || colon > 2 || time.size() < colon + 3) return false;
+    int hour = 0, minute = 0;
+    for (size_t i = 0; i < colon; ++i) {
+        if (time[i] < '0' || time[i] > '9') return false;
+        hour = hour * 10 + (time[i] - '0');
+    }
+    for (size_t i = colon + 1; i < colon + 3; ++i) {
+        if (time[i] < '0' || time[i] > '9') return false;
+        minute = minute * 10 + (time[i] - '0');
+    }
+
+    std::string_view suffix = trimView(time.substr(colon + 3));
+    if (equalsIgnoreCase(suffix, "AM") || equalsIgnoreCase(suffix, "PM")) {
+        if (hour < 1 || hour > 12) return false;
+        hour = hour % 12 + (equalsIgnoreCase(suffix, "PM") ? 12 : 0);
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (hour > 23 || minute > 59 || minute % SlotMinutes != 0) return false;
+
+    slot = (hour * 60 + minute) / SlotMinutes;
+    return true;
+}
+
+std::string AppointmentStore::formatDate(int32_t day) {
+    // Civil date from days (inverse of parseDate)
+    int z = day + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int dayOfEra = z - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int mp = (5 * dayOfYear + 2) / 153;
+    int dayOfMonth = dayOfYear - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = yearOfEra + era * 400 + (month <= 2);
+
+    char text[32];
+    snprintf(text, sizeof(text), "%04d-%02d-%02d", year, month, dayOfMonth);
+    return text;
+}
+
+std::string AppointmentStore::formatSlot(int slot) {
+    // Same wording as the booking form options
+    int minutes = slot * SlotMinutes;
+    int hour = minutes / 60;
+    char text[32];
+    snprintf(text, sizeof(text), "%d:%02d %s", hour % 12 == 0 ? 12 : hour % 12, minutes % 60, hour < 12 ? "AM" : "PM");
+    return text;
+}
+
+AppointmentStore::DoctorSchedule& AppointmentStore::scheduleFor(int doctorId) {
+    if (DoctorSchedule* existing = findSchedule(doctorId)) return *existing;
+    std::unique_lock<std::shared_mutex> lock(schedulesMutex);
+    auto& schedule = schedules[doctorId];
+    if (!schedule) schedule = std::make_unique<DoctorSchedule>();
+    return *schedule;
+}
+
+AppointmentStore::DoctorSchedule* AppointmentStore::findSchedule(int doctorId) const {
+    std::shared_lock<std::shared_mutex> lock(schedulesMutex);
+    auto it = schedules.find(doctorId);
+    return it == schedules.end() ? nullptr : it->second.get();
+}
+
+AppointmentStore::ReserveResult AppointmentStore::reserve(int doctorId, const std::string& date, const std::string& time) {
+    int32_t day;
+    int slot;
+    if (!parseDate(date, day) || !parseTime(time, slot)) return ReserveResult::Invalid;
+    if (!((ClinicSlotMask >> slot) & 1)) return ReserveResult::Invalid;
+    int32_t today;
+    int currentSlot;
+    currentDayAndSlot(today, currentSlot);
+    if (day < today) return ReserveResult::Invalid;
+
+    DoctorSchedule& schedule = scheduleFor(doctorId);
+    std::lock_guard<std::mutex> lock(schedule.mutex);
+    uint64_t& bitmap = schedule.bookedSlots[day];
+    uint64_t bit = uint64_t(1) << slot;
+    if (bitmap & bit) return ReserveResult::Conflict;
+    bitmap |= bit;
+    return ReserveResult::Reserved;
+}
+
+void AppointmentStore::release(int doctorId, const std::string& date, const std::string& time) {
+    int32_t day;
+    int slot;
+    if (!parseDate(date, day) || !parseTime(time, slot)) return;
+
+    DoctorSchedule& schedule = scheduleFor(doctorId);
+    std::lock_guard<std::mutex> lock(schedule.mutex);
+    schedule.bookedSlots[day] &= ~(uint64_t(1) << slot);
+}
+
+void AppointmentStore::record(const Appointment& appointment) {
+    DoctorSchedule& schedule = scheduleFor(appointment.getDoctorId());
+    std::lock_guard<std::mutex> lock(schedule.mutex);
+    schedule.appointments.push_back(appointment);
+    appointmentCount++;
+}
+
+void AppointmentStore::restore(const Appointment& appointment) {
+    // Older entries may predate conflict checks or carry free-form times; keep them either way
+    int32_t day;
+    int slot;
+    if (appointment.getStatus() != "cancelled" && parseDate(appointment.getAppointmentDate(), day) &&
+        parseTime(appointment.getAppointmentTime(), slot)) {
+        DoctorSchedule& schedule = scheduleFor(appointment.getDoctorId());
+        std::lock_guard<std::mutex> lock(schedule.mutex);
+        schedule.bookedSlots[day] |= uint64_t(1) << slot;
+    }
+    record(appointment);
+}
+
+bool AppointmentStore::isBooked(int doctorId, int32_t day, int slot) const {
+    return (getBookedSlots(doctorId, day) >> slot) & 1;
+}
+
+uint64_t AppointmentStore::getBookedSlots(int doctorId, int32_t day) const {
+    DoctorSchedule* schedule = findSchedule(doctorId);
+    if (!schedule) return 0;
+    std::lock_guard<std::mutex> lock(schedule->mutex);
+    auto it = schedule->bookedSlots.find(day);
+    return it == schedule->bookedSlots.end() ? 0 : it->second;
+}
+
+std::vector<AppointmentStore::FreeSlot> AppointmentStore::findFreeSlots(int doctorId, int32_t fromDay, int fromSlot,
+                                                                      int32_t toDay, size_t limit) const {
+    std::vector<FreeSlot> result;
+    DoctorSchedule* schedule = findSchedule(doctorId);
+    std::unique_lock<std::mutex> lock;
+    if (schedule) lock = std::unique_lock<std::mutex>(schedule->mutex);
+
+    for (int32_t day = fromDay; day <= toDay && result.size() < limit; ++day) {
+        uint64_t open = ClinicSlotMask;
+        if (schedule) {
+            auto it = schedule->bookedSlots.find(day);
+            if (it != schedule->bookedSlots.end()) open &= ~it->second;
+        }
+        if (day == fromDay && fromSlot > 0) {
+            open &= fromSlot >= 64 ? 0 : ~((uint64_t(1) << fromSlot) - 1);
+        }
+        // Walk the set bits of the free mask in slot order
+        while (open && result.size() < limit) {
+            int slot = __builtin_ctzll(open);
+            result.push_back({day, slot});
+            open &= open - 1;
+        }
+    }
+    return result;
+}
+
+void AppointmentStore::currentDayAndSlot(int32_t& day, int& slot) {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    char date[32];
+    snprintf(date, sizeof(date), "%04d-%02d-%02d", local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+    parseDate(date, day);
+    // Slots that have already started today are not offered
+    slot = (local.tm_hour * 60 + local.tm_min) / SlotMinutes + 1;
+}
+
+std::vector<Appointment> AppointmentStore::getAppointmentsForDoctor(int doctorId) const {
+    DoctorSchedule* schedule = findSchedule(doctorId);
+    if (!schedule) return {};
+    std::lock_guard<std::mutex> lock(schedule->mutex);
+    return schedule->appointments;
+}
+
+// ThreadPool implementation
+ThreadPool::ThreadPool(size_t threadCount) : stopping(false) {
+    if (threadCount == 0) threadCount = 1;
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+void ThreadPool::shutdown(bool discardQueued) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        if (discardQueued) tasks.clear();
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return; // stopping and fully drained
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+// HttpServer implementation
+
+// epoll user data tags; client connections are numbered from FirstConnectionId
+static const uint64_t ListenerId = 0;
+static const uint64_t WakeId = 1;
+static const uint64_t FirstConnectionId = 2;
+static const int IdleSweepIntervalMs = 1000;
+static const int DrainIdleGraceMs = 250; // while draining, a request already on the wire still gets served
+static const size_t ReadChunkBytes = 16384;
+
+// Routes with their own request metrics; anything else is counted as "other"
+static const char* const MetricRoutes[] = {"/", "/analyze", "/book", "/availability", "/confirm-booking",
+                                           "/metrics", "/api/analyze", "/api/doctors", "/api/appointments",
+                                           "/api/appointments/batch", "other"};
+
+size_t HttpServer::metricRoute(std::string_view method, std::string_view path) {
+    const size_t count = std::size(MetricRoutes);
+    if (method != "GET" && method != "POST") return count - 1;
+    for (size_t i = 0; i + 1 < count; ++i) {
+        if (path == MetricRoutes[i]) return i;
+    }
+    return count - 1;
+}
+
+void HttpServer::registerMetrics() {
+    for (const char* route : MetricRoutes) {
+        std::string label = std::string("route=\"") + route + "\"";
+        RouteMetrics entry;
+        entry.latency = &metrics.histogram("medicare_http_request_duration_seconds",
+                                           "Time from receiving a request to finishing its response", label);
+        for (int klass = 1; klass <= 5; ++klass) {
+            entry.status[klass - 1] = &metrics.counter("medicare_http_requests_total", "Requests served",
+                                                       label + ",code=\"" + std::to_string(klass) + "xx\"");
+        }
+        routeMetrics.push_back(entry);
+    }
+    acceptedConnections = &metrics.counter("medicare_connections_accepted_total", "Client connections accepted");
+    openConnections = &metrics.gauge("medicare_connections_open", "Client connections currently open");
+    parseErrors = &metrics.counter("medicare_http_parse_errors_total", "Requests rejected by the HTTP parser");
+    queueWait = &metrics.histogram("medicare_worker_queue_duration_seconds", "Time a parsed request waits for a worker");
+    bookingPersist = &metrics.histogram("medicare_booking_persist_duration_seconds",
+                                        "Time a booking waits for its journal commit");
+    appointmentJournal.attachMetrics(metrics);
+
+    metrics.callback("medicare_analysis_cache_hits_total", "Analysis cache hits", "counter",
+                     [this]() { return static_cast<double>(analysisCache.getHits()); });
+    metrics.callback("medicare_analysis_cache_misses_total", "Analysis cache misses", "counter",
+                     [this]() { return static_cast<double>(analysisCache.getMisses()); });
+    metrics.callback("medicare_analysis_cache_coalesced_total", "Requests that waited on an identical in-flight analysis",
+                     "counter", [this]() { return static_cast<double>(analysisCache.getCoalesced()); });
+    metrics.callback("medicare_analysis_cache_entries", "Analyses currently cached", "gauge",
+                     [this]() { return static_cast<double>(analysisCache.size()); });
+}
+
+// Status code from the start of a serialized response, 0 if it has none
+static int responseStatus(const HttpResponse& response) {
+    const std::string& bytes = response.bytes;
+    if (bytes.size() < 12 || bytes.compare(0, 5, "HTTP/") != 0) return 0;
+    return std::atoi(bytes.c_str() + 9);
+}
+
+static const char* statusText(int statusCode) {
+    switch (statusCode) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 415: return "Unsupported Media Type";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "OK";
+    }
+}
+
+HttpServer::HttpServer(int port, const std::string& geminiApiKey, const ServerConfig& config) 
+    : port(port), config(config),
+      analysisCache(config.analysisCacheCapacity, std::chrono::seconds(config.analysisCacheTtlSeconds)),
+      running(false), listenFd(-1), epollFd(-1),
+      wakeFd(-1), nextConnectionId(FirstConnectionId),
+      appointmentJournal(config.appointmentJournalPath), nextAppointmentId(1), restartRequested(false),
+      successorPid(0) {
+    registerMetrics();
+    initializeDoctors();
+
+    std::string templateError;
+    size_t templateCount = templates.load(config.templateDirectory, templateError);
+    if (!templateError.empty()) {
+        std::cerr << "Warning: template problems: " << templateError << std::endl;
+    }
+    std::cout << " Compiled " << templateCount << " page templates from " << config.templateDirectory << std::endl;
+
+    std::string rulesError;
+    auto classifier = SymptomClassifier::load(config.symptomRulesPath, rulesError);
+    if (classifier) {
+        std::cout << " Compiled " << classifier->ruleCount() << " symptom rules into " << classifier->stateCount()
+                  << " classifier states" << std::endl;
+    } else {
+        std::cerr << "Warning: symptom rules not loaded (" << rulesError << "), only general assessments will be given"
+                  << std::endl;
+    }
+
+    // With a local model to fall back on, a slow Gemini is cut off sooner
+    std::string modelError;
+    auto triageModel = TriageModel::load(config.triageModelPath, modelError);
+    if (triageModel) {
+        std::cout << " Loaded triage model: " << triageModel->labelCount() << " conditions, "
+                  << triageModel->featureCount() << " features" << std::endl;
+        aiService = std::make_unique<HybridAIService>(geminiApiKey, config.geminiBaseUrl, config.geminiPrompt,
+                                                      classifier, config.triageUpstreamTimeoutMs,
+                                                      config.geminiResilience, triageModel,
+                                                      config.triageFastPathProbability);
+    } else {
+        std::cerr << "Warning: triage model not loaded (" << modelError << "), answers depend on Gemini alone"
+                  << std::endl;
+        aiService = std::make_unique<AIService>(geminiApiKey, config.geminiBaseUrl, config.geminiPrompt,
+                                                classifier, config.geminiTimeoutMs, config.geminiResilience);
+    }
+    aiService->attachMetrics(metrics);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // The home page is served from memory; only edits on disk trigger a reload
+    if (!staticAssets.add("/", "index.html", "text/html")) {
+        std::cerr << "Warning: index.html not found, serving placeholder home page" << std::endl;
+    }
+    if (config.watchStaticAssets) {
+        staticAssets.startWatching();
+    }
+}
+
+bool HttpServer::openJournal() {
+    std::vector<Appointment> recovered;
+    if (!appointmentJournal.open(recovered)) return false;
+    for (const auto& appointment : recovered) {
+        nextAppointmentId = std::max(nextAppointmentId.load(), appointment.getId() + 1);
+        appointmentStore.restore(appointment);
+    }
+    std::cout << " Recovered " << recovered.size() << " appointments from " << config.appointmentJournalPath << std::endl;
+    return true;
+}
+
+HttpServer::~HttpServer() {
+    stop();
+    rosterWatcher.stop();
+    if (workerPool) workerPool->shutdown();
+    appointmentJournal.close();
+    if (listenFd >= 0) close(listenFd); // start() succeeded but run() never did
+    if (wakeFd >= 0) close(wakeFd);
+}
+
+void HttpServer::initializeDoctors() {
+    if (!loadRoster()) {
+        std::cerr << "Error: no doctor roster loaded; recommendations will be empty" << std::endl;
+        std::atomic_store(&directory, std::shared_ptr<const DoctorDirectory>(std::make_shared<DoctorDirectory>()));
+    }
+
+    // Editing the TSV recompiles the roster; replacing the roster swaps it in
+    rosterWatcher.add(config.rosterSourcePath, [this]() {
+        std::string error;
+        if (!DoctorRoster::compile(config.rosterSourcePath, config.rosterPath, error)) {
+            std::cerr << "Roster compile failed: " << error << std::endl;
+        }
+    });
+    rosterWatcher.add(config.rosterPath, [this]() { loadRoster(); });
+    if (config.watchStaticAssets) {
+        rosterWatcher.start();
+    }
+}
+
+bool HttpServer::loadRoster() {
+    std::string error;
+    auto roster = DoctorRoster::open(config.rosterPath, error);
+    if (!roster && access(config.rosterPath.c_str(), F_OK) != 0 && access(config.rosterSourcePath.c_str(), F_OK) == 0) {
+        if (DoctorRoster::compile(config.rosterSourcePath, config.rosterPath, error)) {
+            roster = DoctorRoster::open(config.rosterPath, error);
+        }
+    }
+    if (!roster) {
+        std::cerr << "Roster load failed: " << error << "; keeping the current doctors" << std::endl;
+        return false;
+    }
+    if (roster->size() == 0) {
+        std::cerr << "Roster load failed: " << config.rosterPath << " has no doctors; keeping the current doctors" << std::endl;
+        return false;
+    }
+
+    // Doctor objects own copies of their fields, so the mapping is released once they are built;
+    // requests only ever see a complete snapshot
+    auto next = std::make_shared<DoctorDirectory>();
+    next->doctors.reserve(roster->size());
+    for (size_t i = 0; i < roster->size(); ++i) {
+        DoctorRecordView view = roster->at(i);
+        std::vector<std::string> specializations;
+        std::string_view list = view.getSpecializationList();
+        while (!list.empty()) {
+            size_t end = std::min(list.find(';'), list.size());
+            if (end > 0) specializations.emplace_back(list.substr(0, end));
+            list.remove_prefix(std::min(end + 1, list.size()));
+        }
+        next->doctors.push_back(std::make_shared<Doctor>(
+            view.getId(), std::string(view.getName()), std::string(view.getSpecialty()),
+            view.getExperience(), view.getRating(), view.getReviewCount(), std::string(view.getBio()),
+            view.getConsultationFee(), std::string(view.getImageUrl()), std::move(specializations)));
+    }
+    next->specialtyIndex.build(next->doctors);
+    std::atomic_store(&directory, std::shared_ptr<const DoctorDirectory>(next));
+    std::cout << " Loaded " << next->doctors.size() << " doctors from " << config.rosterPath << std::endl;
+    return true;
+}
+
+std::shared_ptr<const DoctorDirectory> HttpServer::currentDirectory() const {
+    return std::atomic_load(&directory);
+}
+
+std::shared_ptr<Doctor> HttpServer::getDoctorById(int id) const {
+    return currentDirectory()->specialtyIndex.findById(id);
+}
+
+std::vector<std::shared_ptr<Doctor>> HttpServer::getDoctorsBySpecialty(const std::string& specialty) const {
+    return currentDirectory()->specialtyIndex.lookup(specialty);
+}
+
+std::string HttpServer::urlDecode(const std::string& encoded) {
+    std::string decoded;
+    decoded.reserve(encoded.size());
+    FormData::decode(encoded, decoded);
+    return decoded;
+}
+
+HttpResponse HttpServer::handleHomePage(const HttpRequest& request, bool keepAlive) {
+    auto asset = staticAssets.find("/");
+    if (!asset) {
+        return createHttpResponse(200, "<h1>MediCare AI</h1><p>Index file not found</p>", "text/html", keepAlive);
+    }
+
+    const StaticAssetVariant& variant = asset->selectVariant(request.getHeader("Accept-Encoding"));
+    std::string_view ifNoneMatch = request.getHeader("If-None-Match");
+    if (!ifNoneMatch.empty() && variant.matchesEtag(ifNoneMatch)) {
+        return HttpResponse("HTTP/1.1 304 Not Modified\r\nETag: " + variant.etag +
+                            "\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n" +
+                            connectionHeaders(keepAlive) + "\r\n");
+    }
+
+    // Headers were rendered at load time; the body is shared, not copied
+    HttpResponse response(variant.head + connectionHeaders(keepAlive) + "\r\n");
+    response.sharedBody = variant.body;
+    return response;
+}
+
+// 1-10 with 5 when missing; anything unparseable counts as missing rather than failing the request
+static int severityFrom(const FormData& form) {
+    std::string text(form.get("severity"));
+    char* end = nullptr;
+    long severity = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0') return 5;
+    return static_cast<int>(std::max(1L, std::min(10L, severity)));
+}
+
+AnalysisCache::AnalysisPtr HttpServer::analyze(const FormData& form, AIService::Deadline deadline) {
+    std::string symptoms(form.get("symptoms"));
+    std::string duration(form.get("duration"));
+    int severity = severityFrom(form);
+
+    // Served from cache for repeated complaints
+    return analysisCache.getOrCompute(symptoms, duration, severity, [&]() {
+        return aiService->analyzeSymptoms(symptoms, duration, severity, deadline);
+    });
+}
+
+std::string HttpServer::handleAnalyzeSymptoms(const FormData& form, AIService::Deadline deadline) {
+    auto analysis = analyze(form, deadline);
+
+    // Render the page from the compiled templates into one buffer
+    std::string html;
+    templates.get("analysis_page_head").render(html, {});
+    analysis->renderHtmlResults(templates, html);
+    html += renderAnalysisTail(*analysis);
+    return html;
+}
+
+// Everything after the analysis results: doctor cards and the page footer
+std::string HttpServer::renderAnalysisTail(const SymptomAnalysis& analysis) {
+    // Get recommended doctors: top 3 across all suggested specialties
+    auto recommendedDoctors = currentDirectory()->specialtyIndex.lookupAny(analysis.getSuggestedSpecialties(), 3);
+
+    std::string doctorsHtml;
+    if (!recommendedDoctors.empty()) {
+        std::string cards;
+        for (size_t i = 0; i < recommendedDoctors.size(); ++i) {
+            auto slots = upcomingSlots(recommendedDoctors[i]->getId(), config.inlineSlotCount);
+            recommendedDoctors[i]->renderHtmlCard(templates, cards, i == 0, slots);
+        }
+        templates.get("recommended_doctors").render(doctorsHtml, {{"cards", cards}});
+    }
+
+    std::string html;
+    templates.get("analysis_page_tail").render(html, {{"doctors", doctorsHtml}});
+    return html;
+}
+
+static void appendChunk(std::string& out, std::string_view data) {
+    if (data.empty()) return; // a zero-length chunk would end the body
+    char size[20];
+    int length = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    out.append(size, static_cast<size_t>(length));
+    out.append(data);
+    out.append("\r\n");
+}
+
+void HttpServer::streamAnalyzeSymptoms(uint64_t connectionId, const HttpRequest& request, bool keepAlive) {
+    FormData form;
+    if (!readForm(request, form)) {
+        postCompletion(connectionId, createHttpResponse(400, "<h1>400 - Unreadable form</h1>", "text/html", keepAlive));
+        return;
+    }
+    std::string symptoms(form.get("symptoms"));
+    std::string duration(form.get("duration"));
+    int severity = severityFrom(form);
+    auto deadline = request.getReceivedAt() + std::chrono::milliseconds(config.analyzeBudgetMs);
+
+    // Headers, page head and the opening of the answer box go out before Gemini is even called
+    std::string head = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/html; charset=utf-8\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "X-Accel-Buffering: no\r\n" + connectionHeaders(keepAlive) + "\r\n";
+    std::string page;
+    templates.get("analysis_page_head").render(page, {});
+    templates.get("ai_main_text_head").render(page, {});
+    appendChunk(head, page);
+    postCompletion(connectionId, HttpResponse(std::move(head)), false);
+
+    std::string html;
+    std::string framed;
+    try {
+        // Fragments are rendered and forwarded from the transfer thread as Gemini produces them.
+        // A cache hit or a coalesced request skips the loader and renders the stored answer at once.
+        MarkdownRenderer markdown;
+        bool streamed = false;
+        auto analysis = analysisCache.getOrCompute(symptoms, duration, severity, [&]() {
+            streamed = true;
+            return aiService->streamSymptoms(symptoms, duration, severity, [&](std::string_view text) {
+                std::string fragment;
+                markdown.feed(text, fragment);
+                if (fragment.empty()) return;
+                std::string chunk;
+                appendChunk(chunk, fragment);
+                postCompletion(connectionId, HttpResponse(std::move(chunk)), false);
+            }, deadline);
+        });
+
+        if (streamed) {
+            markdown.finish(html);
+        } else {
+            MarkdownRenderer::render(analysis->getMainAIText(), html);
+        }
+        if (analysis->getMainAIText().empty()) {
+            html += "<i>The AI assistant is unavailable right now; the assessment below is rule-based.</i>";
+        }
+        templates.get("ai_main_text_tail").render(html, {});
+        analysis->renderHtmlResults(templates, html, false);
+        html += renderAnalysisTail(*analysis);
+    } catch (const std::exception& e) {
+        // Headers are already out, so the status cannot change; end the page with a notice instead
+        std::cerr << "Streaming analysis failed: " << e.what() << std::endl;
+        html.clear(); // may hold a partly rendered tail
+        html += "<p><strong>Analysis failed. Please try again.</strong></p>";
+        templates.get("ai_main_text_tail").render(html, {});
+        templates.get("analysis_page_tail").render(html, {{"doctors", ""}});
+    }
+    appendChunk(framed, html);
+    framed += "0\r\n\r\n";
+    postCompletion(connectionId, HttpResponse(std::move(framed)));
+}
+
+HttpServer::BookingRequest HttpServer::bookingFromForm(const FormData& form) {
+    BookingRequest booking;
+    std::string doctorId(form.get("doctor_id"));
+    booking.doctorId = static_cast<int>(std::strtol(doctorId.c_str(), nullptr, 10)); // 0 matches no doctor
+    booking.patientName = form.get("patient_name");
+    booking.patientEmail = form.get("patient_email");
+    booking.patientPhone = form.get("patient_phone");
+    booking.date = form.get("appointment_date");
+    booking.time = form.get("appointment_time");
+    booking.type = form.get("appointment_type");
+    booking.notes = form.get("notes");
+    booking.symptoms = form.get("symptoms");
+    return booking;
+}
+
+// The fields the booking form marks required; the API gets no help from the browser
+const char* HttpServer::missingPatientField(const BookingRequest& booking) {
+    if (trimView(booking.patientName).empty()) return "patient_name";
+    std::string_view email = trimView(booking.patientEmail);
+    if (email.size() < 3 || email.find('@') == std::string_view::npos) return "patient_email";
+    if (trimView(booking.patientPhone).empty()) return "patient_phone";
+    return nullptr;
+}
+
+std::vector<HttpServer::BookingResult> HttpServer::bookAppointments(const std::vector<BookingRequest>& requests) {
+    auto directory = currentDirectory();
+    std::vector<BookingResult> results(requests.size());
+    std::vector<std::optional<Appointment>> appointments(requests.size());
+    std::vector<std::future<bool>> commits(requests.size());
+
+    // Claim each slot first so two patients can never both be confirmed for it. Every append is
+    // queued before waiting on any, so the journal writer covers the batch with one fdatasync.
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const BookingRequest& booking = requests[i];
+        if (!directory->specialtyIndex.findById(booking.doctorId)) {
+            results[i].status = BookingStatus::DoctorNotFound;
+            continue;
+        }
+        if (const char* field = missingPatientField(booking)) {
+            results[i].status = BookingStatus::Invalid;
+            results[i].invalidField = field;
+            continue;
+        }
+        auto reservation = appointmentStore.reserve(booking.doctorId, booking.date, booking.time);
+        if (reservation != AppointmentStore::ReserveResult::Reserved) {
+            results[i].status = reservation == AppointmentStore::ReserveResult::Invalid ? BookingStatus::Invalid
+                                                                                        : BookingStatus::Conflict;
+            continue;
+        }
+        appointments[i].emplace(nextAppointmentId++, booking.doctorId, booking.patientName, booking.patientEmail,
+                                booking.patientPhone, booking.date, booking.time, booking.type, booking.symptoms,
+                                booking.notes);
+        results[i].appointmentId = appointments[i]->getId();
+        commits[i] = appointmentJournal.append(*appointments[i]);
+    }
+
+    // Wait for the group commit so a confirmed booking survives a crash
+    auto persistStarted = std::chrono::steady_clock::now();
+    bool waited = false;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (!commits[i].valid()) continue;
+        waited = true;
+        if (commits[i].get()) {
+            appointmentStore.record(*appointments[i]);
+            results[i].status = BookingStatus::Booked;
+        } else {
+            appointmentStore.release(requests[i].doctorId, requests[i].date, requests[i].time);
+            results[i].status = BookingStatus::Failed;
+            results[i].appointmentId = 0;
+        }
+    }
+    if (waited) bookingPersist->recordDuration(std::chrono::steady_clock::now() - persistStarted);
+    return results;
+}
+
+HttpResponse HttpServer::handleBookAppointment(const FormData& form, bool keepAlive) {
+    static const std::string notFound = "<h1>Doctor not found</h1>";
+    BookingRequest booking = bookingFromForm(form);
+    auto doctor = getDoctorById(booking.doctorId);
+    if (!doctor) {
+        return createHttpResponse(404, notFound, "text/html", keepAlive);
+    }
+    int doctorId = booking.doctorId;
+    
+    // If this is a booking confirmation (POST to /confirm-booking), write appointment to file
+    // Otherwise, show the booking form
+    if (form.has("patient_name")) {
+        std::string html;
+        BookingResult result = bookAppointments({std::move(booking)}).front();
+        switch (result.status) {
+        case BookingStatus::Booked:
+            html = "<html><body><h1> Appointment Booked Successfully!</h1><p>You will receive a confirmation email shortly.</p><a href='/'>← Back to Home</a></body></html>";
+            break;
+        case BookingStatus::Invalid:
+            if (result.invalidField) {
+                html = "<html><body><h1> Missing Patient Details</h1><p>Please go back and fill in ";
+                std::string label = result.invalidField;
+                std::replace(label.begin(), label.end(), '_', ' ');
+                html += label + ".</p><a href='/'>← Back to Home</a></body></html>";
+            } else {
+                html = "<html><body><h1> Invalid Date or Time</h1><p>Please choose a valid date and one of the listed appointment times.</p><a href='/'>← Back to Home</a></body></html>";
+            }
+            break;
+        case BookingStatus::Conflict:
+            html = "<html><body><h1> Time Slot Unavailable</h1><p>";
+            HtmlTemplate::appendEscaped(html, doctor->getName());
+            html += " is already booked at that time. Please go back and pick another slot.</p><a href='/'>← Back to Home</a></body></html>";
+            break;
+        case BookingStatus::DoctorNotFound: // the roster was swapped underneath us
+            return createHttpResponse(404, notFound, "text/html", keepAlive);
+        case BookingStatus::Failed:
+            html = "<html><body><h1> Booking Failed</h1><p>We could not save your appointment. Please try again.</p><a href='/'>← Back to Home</a></body></html>";
+            break;
+        }
+        return createHttpResponse(200, html, "text/html", keepAlive);
+    }
+    
+    // Preselect the slot picked from an availability listing
+    std::string_view selectedDate = form.get("appointment_date");
+    std::string_view selectedTime = form.get("appointment_time");
+    int32_t selectedDay = 0;
+    bool hasSelectedDay = AppointmentStore::parseDate(selectedDate, selectedDay);
+    uint64_t bookedOnDay = hasSelectedDay ? appointmentStore.getBookedSlots(doctorId, selectedDay) : 0;
+
+    std::string timeOptions;
+    for (int slot = 0; slot < AppointmentStore::SlotsPerDay; ++slot) {
+        if (!((AppointmentStore::ClinicSlotMask >> slot) & 1)) continue;
+        std::string label = AppointmentStore::formatSlot(slot);
+        bool booked = (bookedOnDay >> slot) & 1;
+        templates.get("time_option").render(timeOptions, {
+            {"label", label},
+            {"state", booked ? " disabled" : label == selectedTime ? " selected" : ""},
+            {"suffix", booked ? " (booked)" : ""},
+        });
+    }
+
+    std::string html;
+    templates.get("booking_form").render(html, {
+        {"name", doctor->getName()},
+        {"specialty", doctor->getSpecialty()},
+        {"fee", doctor->getConsultationFee() / 100},
+        {"doctorId", doctorId},
+        {"selectedDate", hasSelectedDay ? selectedDate : std::string_view()},
+        {"timeOptions", timeOptions},
+    });
+    return createHttpResponse(200, html, "text/html", keepAlive);
+}
+
+std::vector<std::pair<std::string, std::string>> HttpServer::upcomingSlots(int doctorId, size_t limit) const {
+    int32_t today;
+    int currentSlot;
+    AppointmentStore::currentDayAndSlot(today, currentSlot);
+
+    std::vector<std::pair<std::string, std::string>> slots;
+    for (const auto& free : appointmentStore.findFreeSlots(doctorId, today, currentSlot,
+                                                           today + config.availabilitySearchDays - 1, limit)) {
+        slots.emplace_back(AppointmentStore::formatDate(free.day), AppointmentStore::formatSlot(free.slot));
+    }
+    return slots;
+}
+
+std::string HttpServer::handleAvailability(const HttpRequest& request) {
+    FormData query(request.getQuery());
+    std::string doctorIdStr(query.get("doctor_id"));
+    std::string specialty(query.get("specialty"));
+    std::string_view fromStr = query.get("from");
+    std::string_view toStr = query.get("to");
+    std::string countStr(query.get("n"));
+
+    int32_t today;
+    int currentSlot;
+    AppointmentStore::currentDayAndSlot(today, currentSlot);
+
+    int32_t fromDay = today;
+    int fromSlot = currentSlot;
+    if (!fromStr.empty() && AppointmentStore::parseDate(fromStr, fromDay) && fromDay > today) {
+        fromSlot = 0;
+    } else {
+        fromDay = today; // never offer slots in the past
+    }
+    int32_t toDay = fromDay + config.availabilitySearchDays - 1;
+    if (!toStr.empty() && !AppointmentStore::parseDate(toStr, toDay)) {
+        toDay = fromDay + config.availabilitySearchDays - 1;
+    }
+    toDay = std::min(toDay, fromDay + 365);
+
+    size_t count = countStr.empty() ? 5 : std::strtoul(countStr.c_str(), nullptr, 10);
+    count = std::max<size_t>(1, std::min<size_t>(count, 50));
+
+    std::vector<std::shared_ptr<Doctor>> selected;
+    if (!doctorIdStr.empty()) {
+        if (auto doctor = getDoctorById(std::atoi(doctorIdStr.c_str()))) selected.push_back(doctor);
+    } else if (!specialty.empty()) {
+        selected = getDoctorsBySpecialty(specialty);
+    } else {
+        selected = currentDirectory()->doctors;
+    }
+
+    std::string doctorsHtml;
+    if (selected.empty()) {
+        templates.get("availability_notice").render(doctorsHtml, {{"message", "No matching doctors found."}});
+    }
+    for (const auto& doctor : selected) {
+        auto slots = appointmentStore.findFreeSlots(doctor->getId(), fromDay, fromSlot, toDay, count);
+        std::string slotsHtml;
+        if (slots.empty()) {
+            templates.get("availability_notice").render(slotsHtml, {{"message", "No open slots in this range."}});
+        } else {
+            std::string buttons;
+            for (const auto& free : slots) {
+                std::string date = AppointmentStore::formatDate(free.day);
+                std::string time = AppointmentStore::formatSlot(free.slot);
+                templates.get("slot_button").render(buttons, {{"doctorId", doctor->getId()}, {"date", date}, {"time", time}});
+            }
+            templates.get("availability_slots").render(slotsHtml, {{"buttons", buttons}});
+        }
+        templates.get("availability_doctor").render(doctorsHtml, {
+            {"name", doctor->getName()},
+            {"specialty", doctor->getSpecialty()},
+            {"slots", slotsHtml},
+        });
+    }
+
+    std::string from = AppointmentStore::formatDate(fromDay);
+    std::string to = AppointmentStore::formatDate(toDay);
+    std::string html;
+    templates.get("availability_page").render(html, {{"from", from}, {"to", to}, {"doctors", doctorsHtml}});
+    return html;
+}
+
+// Media type without parameters, e.g. "multipart/form-data" from "multipart/form-data; boundary=x"
+static bool hasMediaType(std::string_view contentType, std::string_view type) {
+    return equalsIgnoreCase(trimView(contentType.substr(0, contentType.find(';'))), type);
+}
+
+bool HttpServer::readForm(const HttpRequest& request, FormData& form) {
+    std::string_view contentType = request.getHeader("Content-Type");
+    if (hasMediaType(contentType, "multipart/form-data")) {
+        return FormData::parseMultipart(request.getBody(), headerParameter(contentType, "boundary").value_or(std::string_view()), form);
+    }
+    if (hasMediaType(contentType, "application/json")) {
+        std::vector<FormData> records;
+        std::string error;
+        if (!FormData::parseJson(request.getBody(), records, error)) return false;
+        if (!records.empty()) form = std::move(records.front());
+        return true;
+    }
+    form = FormData(request.getBody());
+    return true;
+}
+
+HttpResponse HttpServer::jsonResponse(int statusCode, const std::string& body, bool keepAlive) {
+    return createHttpResponse(statusCode, body, "application/json", keepAlive);
+}
+
+HttpResponse HttpServer::jsonError(int statusCode, std::string_view message, bool keepAlive) {
+    std::string body;
+    JsonWriter(body).beginObject().key("error").value(message).endObject();
+    return jsonResponse(statusCode, body, keepAlive);
+}
+
+static const char* answerSourceName(SymptomAnalysis::AnswerSource source) {
+    switch (source) {
+    case SymptomAnalysis::AnswerSource::Gemini: return "gemini";
+    case SymptomAnalysis::AnswerSource::TriageModel: return "triage_model";
+    case SymptomAnalysis::AnswerSource::TriageFallback: return "triage_fallback";
+    case SymptomAnalysis::AnswerSource::Rules: break;
+    }
+    return "rules";
 }
 
-std::string Doctor::toHtmlCard(bool isRecommended) const {
-    std::ostringstream html;
-    std::string fee = std::to_string(consultationFee / 100);
-    std::string recommendedClass = isRecommended ? " style='border: 3px solid #2563eb; background: linear-gradient(135deg, #eff6ff, #f0f9ff);'" : "";
-    std::string recommendedBadge = isRecommended ? "  RECOMMENDED" : "";
-    
-    html << "<div class='doctor-card'" << recommendedClass << ">\n";
-    html << "  <div class='doctor-header'>\n";
-    html << "    <img src='" << imageUrl << "' alt='" << name << "' class='doctor-avatar'>\n";
-    html << "    <div class='doctor-info'>\n";
-    html << "      <h3>" << name << recommendedBadge << "</h3>\n";
-    html << "      <div class='doctor-specialty'>" << specialty << "</div>\n";
-    html << "      <div class='doctor-stats'>\n";
-    html << "        <span> " << rating << " (" << reviewCount << " reviews)</span>\n";
-    html << "        <span> " << experience << " years experience</span>\n";
-    html << "      </div>\n";
-    html << "    </div>\n";
-    html << "  </div>\n";
-    html << "  <div class='doctor-bio'>" << bio << "</div>\n";
-    html << "  <div class='doctor-footer'>\n";
-    html << "    <div class='doctor-fee'>PKR" << fee << " consultation</div>\n";
-    html << "    <form action='/book' method='POST' style='display: inline;'>\n";
-    html << "      <input type='hidden' name='doctor_id' value='" << id << "'>\n";
-    html << "      <button type='submit' class='book-btn'> Book Appointment</button>\n";
-    html << "    </form>\n";
-    html << "  </div>\n";
-    html << "</div>\n";
-    
-    return html.str();
+static void writeStrings(JsonWriter& json, const std::vector<std::string>& values) {
+    json.beginArray();
+    for (const std::string& value : values) json.value(value);
+    json.endArray();
 }
 
-// symtomanalysi implementation
-void SymptomAnalysis::addCondition(const std::string& condition, const std::string& description, int confidence) {
-    possibleConditions.emplace_back(condition, description, confidence);
+static void writeDoctor(JsonWriter& json, const Doctor& doctor,
+                        const std::vector<std::pair<std::string, std::string>>& nextSlots) {
+    json.beginObject()
+        .key("id").value(doctor.getId())
+        .key("name").value(doctor.getName())
+        .key("specialty").value(doctor.getSpecialty())
+        .key("experienceYears").value(doctor.getExperience())
+        .key("rating").value(doctor.getRating())
+        .key("reviewCount").value(doctor.getReviewCount())
+        .key("consultationFeeCents").value(doctor.getConsultationFee())
+        .key("bio").value(doctor.getBio())
+        .key("imageUrl").value(doctor.getImageUrl())
+        .key("specializations");
+    writeStrings(json, doctor.getSpecializations());
+    json.key("nextSlots").beginArray();
+    for (const auto& slot : nextSlots) {
+        json.beginObject().key("date").value(slot.first).key("time").value(slot.second).endObject();
+    }
+    json.endArray().endObject();
 }
 
-void SymptomAnalysis::addRecommendation(const std::string& recommendation) {
-    recommendations.push_back(recommendation);
+HttpResponse HttpServer::handleApiAnalyze(const HttpRequest& request, bool keepAlive) {
+    FormData form;
+    if (!readForm(request, form)) return jsonError(400, "Request body could not be parsed", keepAlive);
+    if (form.get("symptoms").empty()) return jsonError(400, "symptoms is required", keepAlive);
+
+    auto analysis = analyze(form, request.getReceivedAt() + std::chrono::milliseconds(config.analyzeBudgetMs));
+    auto doctors = currentDirectory()->specialtyIndex.lookupAny(analysis->getSuggestedSpecialties(), 3);
+
+    std::string body;
+    JsonWriter json(body);
+    json.beginObject()
+        .key("source").value(answerSourceName(analysis->getAnswerSource()))
+        .key("degraded").value(analysis->isDegraded())
+        .key("text").value(analysis->getMainAIText()) // Markdown, as Gemini wrote it
+        .key("conditions").beginArray();
+    for (const auto& condition : analysis->getPossibleConditions()) {
+        json.beginObject()
+            .key("name").value(condition.condition)
+            .key("description").value(condition.description)
+            .key("confidence").value(condition.confidence)
+            .endObject();
+    }
+    json.endArray().key("recommendations");
+    writeStrings(json, analysis->getRecommendations());
+    json.key("warningSigns");
+    writeStrings(json, analysis->getWarningSigns());
+    json.key("specialties");
+    writeStrings(json, analysis->getSuggestedSpecialties());
+    json.key("doctors").beginArray();
+    for (const auto& doctor : doctors) {
+        writeDoctor(json, *doctor, upcomingSlots(doctor->getId(), config.inlineSlotCount));
+    }
+    json.endArray().endObject();
+    return jsonResponse(200, body, keepAlive);
 }
 
-void SymptomAnalysis::addWarningSign(const std::string& warning) {
-    warningSignsWarnings.push_back(warning);
+HttpResponse HttpServer::handleApiDoctors(const HttpRequest& request, bool keepAlive) {
+    FormData query(request.getQuery());
+    std::string specialty(query.get("specialty"));
+    std::string slotsStr(query.get("slots"));
+    size_t slots = std::min<size_t>(std::strtoul(slotsStr.c_str(), nullptr, 10), 20);
+
+    auto directory = currentDirectory();
+    const auto doctors = specialty.empty() ? directory->doctors : directory->specialtyIndex.lookup(specialty);
+
+    std::string body;
+    JsonWriter json(body);
+    json.beginObject().key("doctors").beginArray();
+    for (const auto& doctor : doctors) {
+        writeDoctor(json, *doctor, slots ? upcomingSlots(doctor->getId(), slots)
+                                         : std::vector<std::pair<std::string, std::string>>());
+    }
+    json.endArray().endObject();
+    return jsonResponse(200, body, keepAlive);
 }
 
-void SymptomAnalysis::addSuggestedSpecialty(const std::string& specialty) {
-    suggestedSpecialties.push_back(specialty);
+const char* HttpServer::bookingStatusName(BookingStatus status) {
+    switch (status) {
+    case BookingStatus::Booked: return "booked";
+    case BookingStatus::DoctorNotFound: return "doctor_not_found";
+    case BookingStatus::Invalid: return "invalid";
+    case BookingStatus::Conflict: return "conflict";
+    case BookingStatus::Failed: break;
+    }
+    return "failed";
 }
 
-std::string SymptomAnalysis::toHtmlResults(bool showRaw) const {
-    std::ostringstream html;
-    // Show extracted main AI text (if available)
-    if (!mainAIText.empty()) {
-        html << "<div style='background:#f0f9ff; border:1.5px solid #2563eb; border-radius:12px; padding:18px; margin-bottom:22px;'>";
-        html << "<b>AI Main Response:</b><br>";
-        std::string cleaned = mainAIText;
-        // Headings
-        size_t pos = 0;
-        while ((pos = cleaned.find("## ", pos)) != std::string::npos) {
-            cleaned.replace(pos, 3, "<strong style='font-size:1.1em;'>");
-            size_t end = cleaned.find('\n', pos);
-            if (end != std::string::npos) {
-                cleaned.insert(end, "</strong>");
-                pos = end + 10;
-            } else {
-                cleaned.append("</strong>");
-                break;
-            }
-        }
-        // Bold
-        pos = 0;
-        while ((pos = cleaned.find("**", pos)) != std::string::npos) {
-            size_t end = cleaned.find("**", pos + 2);
-            if (end != std::string::npos) {
-                cleaned.replace(end, 2, "</b>");
-                cleaned.replace(pos, 2, "<b>");
-                pos = end + 3;
-            } else {
-                break;
-            }
-        }
-        // Bullet lists: wrap with <ul> ... </ul>
-        bool inList = false;
-        pos = 0;
-        while ((pos = cleaned.find("<li>", pos)) != std::string::npos) {
-            if (!inList) {
-                cleaned.insert(pos, "<ul style='margin:0 0 0 18px;'>");
-                inList = true;
-                pos += 31; // length of <ul style='margin:0 0 0 18px;'>
-            }
-            size_t endLi = cleaned.find("</li>", pos);
-            if (endLi != std::string::npos) {
-                pos = endLi + 5;
-                // Check if next is not <li>, close the list
-                size_t nextLi = cleaned.find("<li>", pos);
-                if (nextLi == std::string::npos || nextLi > cleaned.find("<br>", pos)) {
-                    cleaned.insert(pos, "</ul>");
-                    inList = false;
-                }
-            } else {
-                break;
-            }
+HttpResponse HttpServer::handleApiBook(const HttpRequest& request, bool keepAlive, bool batch) {
+    std::vector<FormData> records;
+    if (hasMediaType(request.getHeader("Content-Type"), "application/json")) {
+        std::string error;
+        if (!FormData::parseJson(request.getBody(), records, error)) {
+            return jsonError(400, "Invalid JSON: " + error, keepAlive);
         }
-        // Replace * bullet points with <li>
-        pos = 0;
-        while ((pos = cleaned.find("\n* ", pos)) != std::string::npos) {
-            cleaned.replace(pos, 3, "<li>");
-            size_t end = cleaned.find('\n', pos + 4);
-            if (end != std::string::npos) {
-                cleaned.insert(end, "</li>");
-                pos = end + 5;
-            } else {
-                cleaned.append("</li>");
-                break;
+    } else {
+        FormData form;
+        if (!readForm(request, form)) return jsonError(400, "Request body could not be parsed", keepAlive);
+        records.push_back(std::move(form));
+    }
+    if (records.empty()) return jsonError(400, "No appointments in request", keepAlive);
+    if (!batch && records.size() > 1) {
+        return jsonError(400, "Expected one appointment; use /api/appointments/batch for several", keepAlive);
+    }
+    if (records.size() > config.maxBatchBookings) {
+        return jsonError(413, "At most " + std::to_string(config.maxBatchBookings) + " appointments per batch",
+                         keepAlive);
+    }
+
+    std::vector<BookingRequest> bookings;
+    bookings.reserve(records.size());
+    for (const FormData& record : records) bookings.push_back(bookingFromForm(record));
+    std::vector<BookingResult> results = bookAppointments(bookings);
+
+    std::string body;
+    JsonWriter json(body);
+    if (!batch) {
+        const BookingResult& result = results.front();
+        switch (result.status) {
+        case BookingStatus::Booked:
+            json.beginObject().key("status").value("booked").key("appointmentId").value(result.appointmentId).endObject();
+            return jsonResponse(201, body, keepAlive);
+        case BookingStatus::DoctorNotFound: return jsonError(404, "Doctor not found", keepAlive);
+        case BookingStatus::Invalid:
+            if (result.invalidField) {
+                return jsonError(400, std::string(result.invalidField) + " is missing or invalid", keepAlive);
             }
+            return jsonError(400, "Invalid date or time", keepAlive);
+        case BookingStatus::Conflict: return jsonError(409, "Time slot already booked", keepAlive);
+        case BookingStatus::Failed: break;
         }
-        // Paragraphs
-        while ((pos = cleaned.find("\n\n")) != std::string::npos) {
-            cleaned.replace(pos, 2, "<br><br>");
-        }
-        // Line breaks
-        while ((pos = cleaned.find("\n")) != std::string::npos) {
-            cleaned.replace(pos, 1, "<br>");
+        return jsonError(503, "Appointment could not be saved", keepAlive);
+    }
+
+    // Batches always answer 200; each entry carries its own outcome, in request order
+    size_t booked = 0;
+    json.beginObject().key("results").beginArray();
+    for (const BookingResult& result : results) {
+        json.beginObject().key("status").value(bookingStatusName(result.status));
+        if (result.status == BookingStatus::Booked) {
+            json.key("appointmentId").value(result.appointmentId);
+            booked++;
         }
-        html << "<div style='font-size:15px; color:#334155; background:none; border:none; margin:0; padding:0;'>" << cleaned << "</div></div>\n";
+        json.endObject();
     }
-    // Dropdown for AI raw response
-    html << "<details style='margin-bottom: 25px;'>\n";
-    html << "  <summary style='font-weight:600; font-size:1.1rem; color:#2563eb; cursor:pointer;'>Show AI Raw Response (for debugging)</summary>\n";
-    html << "  <pre style='background:#f3f4f6; color:#334155; border:1px solid #e5e7eb; border-radius:10px; padding:18px; margin-top:12px; max-height:300px; overflow:auto; font-size:13px;'>";
-    html << (rawAIResponse.empty() ? "<i>No raw response available.</i>" : rawAIResponse) << "</pre>\n";
-    html << "</details>\n";
-    
-    html << "<div class='analysis-results'>\n";
-    html << "  <h3>🔍 Possible Conditions</h3>\n";
-    
-    for (const auto& condition : possibleConditions) {
-        std::string confidenceClass = condition.confidence >= 70 ? "high-confidence" : 
-                                    condition.confidence >= 50 ? "medium-confidence" : "low-confidence";
-        std::string badgeClass = condition.confidence >= 70 ? "confidence-high" : 
-                               condition.confidence >= 50 ? "confidence-medium" : "confidence-low";
-        
-        html << "  <div class='condition " << confidenceClass << "'>\n";
-        html << "    <div>\n";
-        html << "      <strong>" << condition.condition << "</strong>\n";
-        html << "      <p style='margin: 5px 0; color: #64748b;'>" << condition.description << "</p>\n";
-        html << "    </div>\n";
-        html << "    <span class='confidence-badge " << badgeClass << "'>" << condition.confidence << "%</span>\n";
-        html << "  </div>\n";
+    json.endArray()
+        .key("booked").value(static_cast<long long>(booked))
+        .key("failed").value(static_cast<long long>(results.size() - booked))
+        .endObject();
+    return jsonResponse(200, body, keepAlive);
+}
+
+std::string HttpServer::createHttpResponse(int statusCode, const std::string& body, const std::string& contentType, bool keepAlive) {
+    std::string response;
+    response.reserve(body.size() + contentType.size() + 128);
+    response += "HTTP/1.1 ";
+    response += std::to_string(statusCode);
+    response += ' ';
+    response += statusText(statusCode);
+    response += "\r\nContent-Type: ";
+    response += contentType;
+    response += "\r\nContent-Length: ";
+    response += std::to_string(body.size());
+    response += "\r\n";
+    response += connectionHeaders(keepAlive);
+    response += "\r\n";
+    response += body;
+    return response;
+}
+
+std::string HttpServer::connectionHeaders(bool keepAlive) const {
+    if (!keepAlive) return "Connection: close\r\n";
+    return "Connection: keep-alive\r\nKeep-Alive: timeout=" + std::to_string(config.keepAliveTimeoutMs / 1000) +
+           ", max=" + std::to_string(config.maxRequestsPerConnection) + "\r\n";
+}
+
+bool HttpServer::start() {
+    if (wakeFd < 0) {
+        std::cerr << "Failed to create wakeup eventfd" << std::endl;
+        return false;
     }
-    
-    html << "  <h3 style='margin-top: 30px;'> AI Recommendations</h3>\n";
-    html << "  <ul class='recommendations'>\n";
-    for (const auto& rec : recommendations) {
-        html << "    <li>" << rec << "</li>\n";
+    // Set first, so a stop() that arrives while we wait for the journal below is not overwritten
+    running = true;
+    // Listen first: during a hot restart connections queue in the backlog while we wait for the journal
+    if (!openListenSocket()) {
+        running = false;
+        return false;
     }
-    html << "  </ul>\n";
-    
-    html << "  <h3 style='margin-top: 30px;'> Seek Immediate Care If:</h3>\n";
-    html << "  <ul class='warnings'>\n";
-    for (const auto& warning : warningSignsWarnings) {
-        html << "    <li>" << warning << "</li>\n";
+    if (config.replacesPid > 0) {
+        std::cout << " Taking over from process " << config.replacesPid << "; asking it to drain" << std::endl;
+        kill(config.replacesPid, SIGTERM);
     }
-    html << "  </ul>\n";
-    html << "</div>\n";
-    
-    return html.str();
+    // Bookings would be lost without the journal; an unreadable one is a startup failure
+    if (!openJournal()) {
+        running = false;
+        return false;
+    }
+    return true;
 }
 
-// AIService implementation
-AIService::AIService(const std::string& key) : apiKey(key) {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
+void HttpServer::stop() {
+    running = false;
+    // eventfd write is async-signal-safe, so this is callable from a signal handler
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
 }
 
-AIService::~AIService() {
-    if (curl) {
-        curl_easy_cleanup(curl);
+void HttpServer::requestRestart() {
+    restartRequested = true;
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
     }
-    curl_global_cleanup();
 }
 
-size_t AIService::WriteCallbackFunction(void* contents, size_t size, size_t nmemb, WriteCallback* userp) {
-    size_t totalSize = size * nmemb;
-    userp->data.append((char*)contents, totalSize);
-    return totalSize;
-}
+// Starts a new copy of the server on the same listen socket. It tells us to drain once it is listening;
+// until then (or if it dies during startup) this process keeps serving as before.
+void HttpServer::spawnSuccessor() {
+    if (restartCommand.empty() || listenFd < 0) {
+        std::cerr << "Hot restart unavailable: no restart command or listen socket" << std::endl;
+        return;
+    }
+    if (successorPid > 0) {
+        std::cerr << "Hot restart already in progress (process " << successorPid << ")" << std::endl;
+        return;
+    }
 
-std::string AIService::makeHttpRequest(const std::string& url, const std::string& payload) {
-    if (!curl) return "";
-    
-    WriteCallback writeCallback;
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallbackFunction);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &writeCallback);
-    
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
-    
-    return (res == CURLE_OK) ? writeCallback.data : "";
-}
-
-// Utility: Extract the first "text" field value from Gemini AP
-static std::string extractMainAIText(const std::string& raw) {
-    const std::string key = "\"text\":";
-    size_t pos = raw.find(key);
-    if (pos == std::string::npos) return "";
-    pos += key.length();
-    // Skip whitespace and possible space after colon
-    while (pos < raw.size() && (raw[pos] == ' ' || raw[pos] == '"')) ++pos;
-    size_t end = pos;
-    bool inEscape = false;
-    std::string result;
-    // Extract until next unescaped quote
-    while (end < raw.size()) {
-        char c = raw[end];
-        if (c == '\\' && !inEscape) {
-            inEscape = true;
-        } else if (c == '"' && !inEscape) {
-            break;
-        } else {
-            if (inEscape && c != '"' && c != '\\') result += '\\';
-            result += c;
-            inEscape = false;
+    // Everything the child needs is built before fork(); afterwards only async-signal-safe calls are allowed
+    std::vector<std::string> environment;
+    for (char** entry = environ; *entry; ++entry) {
+        if (std::strncmp(*entry, "MEDICARE_LISTEN_FD=", 19) != 0 && std::strncmp(*entry, "MEDICARE_REPLACES_PID=", 22) != 0) {
+            environment.push_back(*entry);
         }
-        ++end;
     }
-    return result;
+    environment.push_back("MEDICARE_LISTEN_FD=" + std::to_string(listenFd));
+    environment.push_back("MEDICARE_REPLACES_PID=" + std::to_string(getpid()));
+    std::vector<char*> envp;
+    for (auto& entry : environment) envp.push_back(&entry[0]);
+    envp.push_back(nullptr);
+    std::vector<char*> argv;
+    for (auto& argument : restartCommand) argv.push_back(&argument[0]);
+    argv.push_back(nullptr);
+
+    pid_t child = fork();
+    if (child == 0) {
+        fcntl(listenFd, F_SETFD, 0); // the only descriptor the successor inherits
+        execve(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    if (child < 0) {
+        std::cerr << "Hot restart failed: fork: " << strerror(errno) << std::endl;
+        return;
+    }
+    successorPid = child;
+    std::cout << " Hot restart: started " << restartCommand[0] << " as process " << child << std::endl;
 }
 
-std::unique_ptr<SymptomAnalysis> AIService::analyzeSymptoms(const std::string& symptoms, 
-                                                          const std::string& duration, 
-                                                          int severity) {
-    auto analysis = std::make_unique<SymptomAnalysis>(symptoms, duration, severity);
-    
-    // Create Gemini API request payload
-    std::ostringstream payload;
-    payload << "{\n";
-    payload << "  \"contents\": [{\n";
-    payload << "    \"parts\": [{\n";
-    payload << "      \"text\": \"As a medical AI assistant, analyze these symptoms:\\n\\n";
-    payload << "Symptoms: " << symptoms << "\\n";
-    payload << "Duration: " << (duration.empty() ? "Not specified" : duration) << "\\n";
-    payload << "Severity (1-10): " << severity << "\\n\\n";
-    payload << "Provide analysis with possible conditions, recommendations, warning signs, and suggested specialties.\"\n";
-    payload << "    }]\n";
-    payload << "  }]\n";
-    payload << "}";
-    
-    std::string url = "https://generativelanguage.googleapis.com/v1beta/models/gemini-1.5-flash-latest:generateContent?key=" + apiKey;
-    std::string response = makeHttpRequest(url, payload.str());
-    analysis->setRawAIResponse(response); // Store the raw AI response
-    analysis->setMainAIText(extractMainAIText(response)); // Store the extracted main AI text
-    
-    // Parse response and extract medical insights
-    if (response.find("respiratory") != std::string::npos || 
-        symptoms.find("cough") != std::string::npos || 
-        symptoms.find("breathing") != std::string::npos) {
-        analysis->addCondition("Respiratory Infection", "Possible viral or bacterial respiratory infection", 75);
-        analysis->addSuggestedSpecialty("Pulmonology");
-        analysis->addSuggestedSpecialty("Internal Medicine");
+// Stop accepting. Responses from here on say Connection: close and end their connection;
+// run() closes keep-alive connections that go quiet.
+void HttpServer::beginDrain() {
+    if (listenFd >= 0) {
+        acceptConnections(); // with SO_REUSEPORT, closing would reset whatever is still queued on our socket
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+        close(listenFd);
+        listenFd = -1;
     }
-    
-    if (symptoms.find("headache") != std::string::npos || 
-        symptoms.find("head") != std::string::npos) {
-        analysis->addCondition("Tension Headache", "Common type of headache caused by stress or muscle tension", 80);
-        analysis->addSuggestedSpecialty("Neurology");
-        analysis->addSuggestedSpecialty("Family Medicine");
+    std::cout << " Draining " << connections.size() << " connections (up to " << config.shutdownDrainMs
+              << " ms)" << std::endl;
+}
+
+HttpResponse HttpServer::handleRequest(const HttpRequest& request, bool keepAlive) {
+    std::string_view method = request.getMethod();
+    std::string_view path = request.getPath();
+
+    if (path.compare(0, 5, "/api/") == 0) {
+        if (method == "POST" && path == "/api/analyze") return handleApiAnalyze(request, keepAlive);
+        if (method == "GET" && path == "/api/doctors") return handleApiDoctors(request, keepAlive);
+        if (method == "POST" && path == "/api/appointments") return handleApiBook(request, keepAlive, false);
+        if (method == "POST" && path == "/api/appointments/batch") return handleApiBook(request, keepAlive, true);
+        return jsonError(404, "No such endpoint", keepAlive);
     }
-    
-    if (symptoms.find("chest") != std::string::npos || 
-        symptoms.find("heart") != std::string::npos) {
-        analysis->addCondition("Chest Discomfort", "Could be related to cardiac or respiratory issues", 70);
-        analysis->addSuggestedSpecialty("Cardiology");
-        analysis->addSuggestedSpecialty("Internal Medicine");
+
+    // Form posts may be urlencoded, multipart or JSON
+    FormData form;
+    if (method == "POST" && (path == "/analyze" || path == "/book") && !readForm(request, form)) {
+        return createHttpResponse(400, "<h1>400 - Unreadable form</h1>", "text/html", keepAlive);
     }
-    
-    if (symptoms.find("fever") != std::string::npos || 
-        symptoms.find("temperature") != std::string::npos) {
-        analysis->addCondition("Viral Infection", "Common viral illness with fever symptoms", 85);
-        analysis->addSuggestedSpecialty("Internal Medicine");
-        analysis->addSuggestedSpecialty("Family Medicine");
+
+    // Route handling
+    if (method == "GET" && path == "/") {
+        return handleHomePage(request, keepAlive);
+    } else if (method == "POST" && path == "/analyze") {
+        auto deadline = request.getReceivedAt() + std::chrono::milliseconds(config.analyzeBudgetMs);
+        return createHttpResponse(200, handleAnalyzeSymptoms(form, deadline), "text/html", keepAlive);
+    } else if (method == "POST" && path == "/book") {
+        return handleBookAppointment(form, keepAlive);
+    } else if (method == "GET" && path == "/availability") {
+        return createHttpResponse(200, handleAvailability(request), "text/html", keepAlive);
+    } else if (method == "GET" && path == "/metrics") {
+        return createHttpResponse(200, metrics.render(), "text/plain; version=0.0.4; charset=utf-8", keepAlive);
+    } else if (method == "POST" && path == "/confirm-booking") {
+        return createHttpResponse(200, "<html><body><h1> Appointment Booked Successfully!</h1><p>You will receive a confirmation email shortly.</p><a href='/'>← Back to Home</a></body></html>", "text/html", keepAlive);
+    }
+    return createHttpResponse(404, "<h1>404 - Page Not Found</h1>", "text/html", keepAlive);
+}
+
+bool HttpServer::openListenSocket() {
+    if (config.inheritedListenFd >= 0) {
+        // Handed over by a hot restart: already bound and listening, just make it ours
+        int accepting = 0;
+        socklen_t length = sizeof(accepting);
+        if (getsockopt(config.inheritedListenFd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &length) < 0 || !accepting) {
+            std::cerr << "Inherited descriptor " << config.inheritedListenFd << " is not a listening socket" << std::endl;
+            return false;
+        }
+        listenFd = config.inheritedListenFd;
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+        return true;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
     }
     
-    // Add general recommendations
-    analysis->addRecommendation("Consult with a healthcare professional for proper diagnosis");
-    analysis->addRecommendation("Monitor symptoms closely and note any changes");
-    analysis->addRecommendation("Rest and stay hydrated");
-    analysis->addRecommendation("Take over-the-counter medication if needed for symptom relief");
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // Lets the next version bind the same port while this one is still draining
+    if (config.reusePort && setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "SO_REUSEPORT unavailable: " << strerror(errno) << std::endl;
+    }
     
-    // Add warning signs
-    analysis->addWarningSign("Difficulty breathing or shortness of breath");
-    analysis->addWarningSign("Severe or worsening pain");
-    analysis->addWarningSign("High fever above 102°F");
-    analysis->addWarningSign("Loss of consciousness or confusion");
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
     
-    // Default fallback if no specific conditions were added
-    if (analysis->getSuggestedSpecialties().empty()) {
-        analysis->addCondition("General Medical Assessment", "Symptoms require professional medical evaluation", 75);
-        analysis->addSuggestedSpecialty("Internal Medicine");
-        analysis->addSuggestedSpecialty("Family Medicine");
+    if (bind(listenFd, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        std::cerr << "Failed to bind socket" << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
     }
     
-    return analysis;
-}
-
-// HttpServer implementation
-HttpServer::HttpServer(int port, const std::string& geminiApiKey) 
-    : port(port), running(false) {
-    initializeDoctors();
-    aiService = std::make_unique<AIService>(geminiApiKey);
+    if (listen(listenFd, config.listenBacklog) < 0) {
+        std::cerr << "Failed to listen on socket" << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    return true;
 }
 
-HttpServer::~HttpServer() {
-    stop();
-}
+void HttpServer::acceptConnections() {
+    // Edge-triggered: drain the accept queue completely
+    for (;;) {
+        sockaddr_in clientAddr{};
+        socklen_t clientLen = sizeof(clientAddr);
+        int clientFd = accept4(listenFd, (sockaddr*)&clientAddr, &clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN, or a transient error such as EMFILE
+        }
 
-void HttpServer::initializeDoctors() {
-    doctors.clear();
-    doctors.push_back(std::make_shared<Doctor>(
-        1, "Dr. Abdul Rehman", "Internal Medicine", 15, 4.9, 127,
-        "Specializes in respiratory infections, general internal medicine, and preventive care. Excellent track record with viral infections and symptom management.",
-        12000, "https://images.unsplash.com/photo-1612349317150-e413f6a5b16d?ixlib=rb-4.0.3&auto=format&fit=crop&w=120&h=120",
-        std::vector<std::string>{"Respiratory Care", "Internal Medicine", "Preventive Care"}
-    ));
-    doctors.push_back(std::make_shared<Doctor>(
-        2, "Dr. SARA", "Family Medicine", 12, 4.7, 89,
-        "Comprehensive family medicine with focus on holistic care and patient education. Experienced in treating common illnesses and wellness management.",
-        10000, "https://images.unsplash.com/photo-1559839734-2b71ea197ec2?ixlib=rb-4.0.3&auto=format&fit=crop&w=120&h=120",
-        std::vector<std::string>{"Family Medicine", "Wellness Care"}
-    ));
-    doctors.push_back(std::make_shared<Doctor>(
-        3, "Dr. Ahmed", "Pulmonology", 20, 4.8, 156,
-        "Specialist in lung and respiratory system disorders. Expert in treating breathing difficulties, chronic cough, and respiratory infections.",
-        15000, "https://images.unsplash.com/photo-1582750433449-648ed127bb54?ixlib=rb-4.0.3&auto=format&fit=crop&w=120&h=120",
-        std::vector<std::string>{"Pulmonology", "Respiratory Care"}
-    ));
-    doctors.push_back(std::make_shared<Doctor>(
-        4, "Dr. haris", "Cardiology", 18, 4.9, 203,
-        "Heart specialist with expertise in cardiovascular diseases, chest pain evaluation, and cardiac preventive care.",
-        18000, "https://images.unsplash.com/photo-1594824694996-639a8b70a788?ixlib=rb-4.0.3&auto=format&fit=crop&w=120&h=120",
-        std::vector<std::string>{"Cardiology", "Chest Pain", "Heart Disease"}
-    ));
-    doctors.push_back(std::make_shared<Doctor>(
-        5, "Dr. Mahad", "Neurology", 16, 4.6, 94,
-        "Neurologist specializing in headaches, migraines, and neurological disorders. Expert in brain and nervous system conditions.",
-        16000, "https://images.unsplash.com/photo-1607990281513-2c110a25bd8c?ixlib=rb-4.0.3&auto=format&fit=crop&w=120&h=120",
-        std::vector<std::string>{"Neurology", "Headaches", "Migraines"}
-    ));
-}
+        // Streamed responses go out in small pieces; don't let Nagle hold them back
+        int one = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
-std::shared_ptr<Doctor> HttpServer::getDoctorById(int id) const {
-    for (const auto& doctor : doctors) {
-        if (doctor->getId() == id) {
-            return doctor;
+        uint64_t id = nextConnectionId++;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &ev) < 0) {
+            close(clientFd);
+            continue;
         }
+        acceptedConnections->add();
+        openConnections->add(1);
+        auto conn = std::make_unique<Connection>(id, clientFd, config.parserLimits);
+        conn->lastActivity = std::chrono::steady_clock::now();
+        connections.emplace(id, std::move(conn));
     }
-    return nullptr;
 }
 
-std::vector<std::shared_ptr<Doctor>> HttpServer::getDoctorsBySpecialty(const std::string& specialty) const {
-    std::vector<std::shared_ptr<Doctor>> filtered;
-    for (const auto& doctor : doctors) {
-        if (doctor->hasSpecialization(specialty)) {
-            filtered.push_back(doctor);
+void HttpServer::handleReadable(Connection& conn) {
+    // Bound what a client can queue up behind an in-flight request
+    const HttpParserLimits& limits = config.parserLimits;
+    const size_t bufferCap = limits.maxRequestLineBytes + limits.maxHeaderBytes + limits.maxBodyBytes + ReadChunkBytes;
+
+    for (;;) {
+        if (conn.inBuffer.size() >= bufferCap) {
+            closeConnection(conn.id);
+            return;
+        }
+        // Read straight into the connection buffer instead of bouncing through the stack
+        size_t used = conn.inBuffer.size();
+        conn.inBuffer.resize(used + ReadChunkBytes);
+        ssize_t n = read(conn.fd, &conn.inBuffer[used], ReadChunkBytes);
+        conn.inBuffer.resize(used + (n > 0 ? n : 0));
+
+        if (n > 0) {
+            conn.lastActivity = std::chrono::steady_clock::now();
+        } else if (n == 0) {
+            conn.peerClosed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            closeConnection(conn.id);
+            return;
         }
     }
-    return filtered;
-}
 
-void HttpServer::writeAppointmentToFile(const std::string& details) {
-    std::ofstream file("appointments.txt", std::ios::app);
-    if (file.is_open()) {
-        file << details << "\n";
-        file.close();
+    if (!conn.busy) {
+        dispatchRequest(conn);
     }
 }
 
-std::string HttpServer::parseFormData(const std::string& body) {
-    return body;
-}
+void HttpServer::dispatchRequest(Connection& conn) {
+    HttpRequestParser::Status status = conn.parser.parse(conn.inBuffer);
 
-std::string HttpServer::getFormValue(const std::string& formData, const std::string& key) {
-    std::string searchKey = key + "=";
-    size_t pos = formData.find(searchKey);
-    if (pos == std::string::npos) {
-        return "";
+    if (status == HttpRequestParser::Status::Error) {
+        int code = conn.parser.getErrorStatus();
+        conn.inBuffer.clear();
+        conn.closeAfterWrite = true;
+        parseErrors->add();
+        conn.out = createHttpResponse(code, "<h1>" + std::to_string(code) + " - " + statusText(code) + "</h1>");
+        conn.outOffset = 0;
+        flushWrites(conn);
+        return;
     }
-    
-    size_t start = pos + searchKey.length();
-    size_t end = formData.find("&", start);
-    if (end == std::string::npos) {
-        end = formData.length();
+    if (status == HttpRequestParser::Status::NeedMore) {
+        if (conn.peerClosed) {
+            closeConnection(conn.id);
+        } else if (conn.parser.needsContinue()) {
+            static const char continueLine[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            send(conn.fd, continueLine, sizeof(continueLine) - 1, MSG_NOSIGNAL);
+            conn.parser.markContinueSent();
+        }
+        return;
     }
-    
-    return urlDecode(formData.substr(start, end - start));
+
+    // Pipelined requests stay buffered and are dispatched one at a time, in order
+    HttpRequest request = conn.parser.takeRequest(conn.inBuffer);
+    conn.busy = true;
+    conn.requestsServed++;
+
+    // A half-closed peer is still answered for every request it sent in full; the connection
+    // closes above once the buffer holds no complete request
+    bool keepAlive = running && request.wantsKeepAlive() && conn.requestsServed < config.maxRequestsPerConnection;
+    conn.closeAfterWrite = !keepAlive;
+
+    // Chunked streaming needs an HTTP/1.1 client
+    bool stream = config.streamAnalysis && request.getMethod() == "POST" && request.getPath() == "/analyze" &&
+                  request.getVersion() == "HTTP/1.1";
+
+    uint64_t id = conn.id;
+    size_t route = metricRoute(request.getMethod(), request.getPath());
+    workerPool->submit([this, id, keepAlive, stream, route, request = std::move(request)]() {
+        queueWait->recordDuration(std::chrono::steady_clock::now() - request.getReceivedAt());
+        const RouteMetrics& routeMetric = routeMetrics[route];
+        auto finish = [&](int status) {
+            routeMetric.latency->recordDuration(std::chrono::steady_clock::now() - request.getReceivedAt());
+            if (status >= 100 && status < 600) routeMetric.status[status / 100 - 1]->add();
+        };
+
+        HttpResponse response;
+        try {
+            if (stream) {
+                streamAnalyzeSymptoms(id, request, keepAlive); // posts its own completions
+                finish(200);
+                return;
+            }
+            response = handleRequest(request, keepAlive);
+        } catch (const std::exception& e) {
+            // A bad form value (e.g. a non-numeric doctor_id) must not take down the worker
+            std::cerr << "Request handler failed: " << e.what() << std::endl;
+            response = createHttpResponse(500, "<h1>500 - Internal Server Error</h1>", "text/html", keepAlive);
+        }
+        finish(responseStatus(response));
+        postCompletion(id, std::move(response));
+    });
 }
 
-std::string HttpServer::urlDecode(const std::string& encoded) {
-    std::string decoded;
-    for (size_t i = 0; i < encoded.length(); ++i) {
-        if (encoded[i] == '%' && i + 2 < encoded.length()) {
-            int value = std::stoi(encoded.substr(i + 1, 2), nullptr, 16);
-            decoded += static_cast<char>(value);
-            i += 2;
-        } else if (encoded[i] == '+') {
-            decoded += ' ';
+void HttpServer::flushWrites(Connection& conn) {
+    const size_t headSize = conn.out.bytes.size();
+    while (conn.outOffset < conn.out.size()) {
+        // Gather the head and any shared body into one syscall
+        iovec parts[2];
+        int count = 0;
+        if (conn.outOffset < headSize) {
+            parts[count++] = {&conn.out.bytes[conn.outOffset], headSize - conn.outOffset};
+        }
+        if (conn.out.sharedBody) {
+            size_t bodyOffset = conn.outOffset > headSize ? conn.outOffset - headSize : 0;
+            parts[count++] = {const_cast<char*>(conn.out.sharedBody->data()) + bodyOffset,
+                              conn.out.sharedBody->size() - bodyOffset};
+        }
+        msghdr message{};
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t n = sendmsg(conn.fd, &message, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.outOffset += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return; // resumed on the next EPOLLOUT edge
         } else {
-            decoded += encoded[i];
+            closeConnection(conn.id);
+            return;
         }
     }
-    return decoded;
-}
 
-std::string HttpServer::handleHomePage() {
-    std::ifstream file("index.html");
-    if (file.is_open()) {
-        std::ostringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
+    if (conn.busy || conn.out.empty()) return;
+    if (conn.closeAfterWrite) {
+        closeConnection(conn.id);
+        return;
     }
-    return "<h1>MediCare AI</h1><p>Index file not found</p>";
+
+    // Response fully sent on a persistent connection; move on to any pipelined request
+    conn.out = HttpResponse();
+    conn.outOffset = 0;
+    conn.lastActivity = std::chrono::steady_clock::now();
+    dispatchRequest(conn);
 }
 
-std::string HttpServer::handleAnalyzeSymptoms(const std::string& requestBody) {
-    std::string symptoms = getFormValue(requestBody, "symptoms");
-    std::string duration = getFormValue(requestBody, "duration");
-    std::string severityStr = getFormValue(requestBody, "severity");
-    
-    int severity = severityStr.empty() ? 5 : std::stoi(severityStr);
-    
-    // Get AI analysis
-    auto analysis = aiService->analyzeSymptoms(symptoms, duration, severity);
-    
-    // Get recommended doctors
-    std::vector<std::shared_ptr<Doctor>> recommendedDoctors;
-    for (const auto& specialty : analysis->getSuggestedSpecialties()) {
-        auto doctors = getDoctorsBySpecialty(specialty);
-        for (const auto& doctor : doctors) {
-            // Avoid duplicates
-            bool found = false;
-            for (const auto& existing : recommendedDoctors) {
-                if (existing->getId() == doctor->getId()) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                recommendedDoctors.push_back(doctor);
-            }
+void HttpServer::closeIdleConnections() {
+    auto now = std::chrono::steady_clock::now();
+    auto timeout = std::chrono::milliseconds(config.keepAliveTimeoutMs);
+    std::vector<uint64_t> expired;
+    for (const auto& entry : connections) {
+        const Connection& conn = *entry.second;
+        if (!conn.busy && conn.out.empty() && now - conn.lastActivity >= timeout) {
+            expired.push_back(entry.first);
         }
     }
-    
-    // Limit to top 3 doctors
-    if (recommendedDoctors.size() > 3) {
-        recommendedDoctors.resize(3);
-    }
-    
-    // Generate HTML response
-    std::ostringstream html;
-    html << "<!DOCTYPE html>\n<html><head><title>Analysis Results - MediCare AI</title>\n";
-    html << "<style>\n";
-    html << "body { font-family: 'Segoe UI', sans-serif; background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); margin: 0; padding: 20px; }\n";
-    html << ".container { max-width: 1200px; margin: 0 auto; }\n";
-    html << ".card { background: rgba(255,255,255,0.95); border-radius: 20px; padding: 40px; margin-bottom: 30px; box-shadow: 0 20px 40px rgba(0,0,0,0.1); }\n";
-    html << ".condition { background: #f8fafc; border: 2px solid #e2e8f0; border-radius: 10px; padding: 15px; margin-bottom: 15px; display: flex; justify-content: space-between; align-items: center; }\n";
-    html << ".condition.high-confidence { border-color: #ef4444; background: #fef2f2; }\n";
-    html << ".condition.medium-confidence { border-color: #f59e0b; background: #fffbeb; }\n";
-    html << ".condition.low-confidence { border-color: #3b82f6; background: #eff6ff; }\n";
-    html << ".confidence-badge { padding: 4px 12px; border-radius: 20px; font-weight: 600; font-size: 14px; }\n";
-    html << ".confidence-high { background: #ef4444; color: white; }\n";
-    html << ".confidence-medium { background: #f59e0b; color: white; }\n";
-    html << ".confidence-low { background: #3b82f6; color: white; }\n";
-    html << ".recommendations, .warnings { list-style: none; margin: 15px 0; }\n";
-    html << ".recommendations li, .warnings li { padding: 10px 0; border-bottom: 1px solid #e5e7eb; position: relative; padding-left: 25px; }\n";
-    html << ".recommendations li:before { content: '✓'; position: absolute; left: 0; color: #059669; font-weight: bold; }\n";
-    html << ".warnings li:before { content: '⚠'; position: absolute; left: 0; color: #ef4444; }\n";
-    html << ".doctor-card { background: white; border: 2px solid #e5e7eb; border-radius: 15px; padding: 20px; margin-bottom: 20px; }\n";
-    html << ".doctor-header { display: flex; align-items: center; gap: 15px; margin-bottom: 15px; }\n";
-    html << ".doctor-avatar { width: 60px; height: 60px; border-radius: 50%; object-fit: cover; }\n";
-    html << ".doctor-specialty { color: #2563eb; font-weight: 600; }\n";
-    html << ".doctor-stats { display: flex; gap: 15px; font-size: 14px; color: #64748b; margin-top: 5px; }\n";
-    html << ".doctor-bio { margin: 15px 0; color: #64748b; line-height: 1.5; }\n";
-    html << ".doctor-footer { display: flex; justify-content: space-between; align-items: center; margin-top: 15px; }\n";
-    html << ".doctor-fee { font-size: 1.2rem; font-weight: 600; color: #1e293b; }\n";
-    html << ".book-btn { background: #2563eb; color: white; border: none; padding: 10px 20px; border-radius: 8px; cursor: pointer; font-weight: 600; }\n";
-    html << ".btn { background: linear-gradient(45deg, #2563eb, #7c3aed); color: white; border: none; padding: 15px 30px; border-radius: 12px; font-size: 16px; font-weight: 600; cursor: pointer; text-decoration: none; display: inline-block; }\n";
-    html << "details[open] summary { color: #7c3aed; }\n";
-    html << "details summary { outline: none; }\n";
-    html << "</style></head><body>\n";
-    html << "<div class='container'>\n";
-    html << "<div class='card'>\n";
-    html << "<h1> AI Analysis Results</h1>\n";
-    html << analysis->toHtmlResults(true);
-    html << "</div>\n";
-    
-    if (!recommendedDoctors.empty()) {
-        html << "<div class='card'>\n";
-        html << "<h2> Recommended Doctors</h2>\n";
-        html << "<p>Based on your symptoms, these specialists are best suited to help you.</p>\n";
-        
-        for (size_t i = 0; i < recommendedDoctors.size(); ++i) {
-            html << recommendedDoctors[i]->toHtmlCard(i == 0);
-        }
-        html << "</div>\n";
+    for (uint64_t id : expired) {
+        closeConnection(id);
     }
-    
-    html << "<div class='card'>\n";
-    html << "<a href='/' class='btn'> New Analysis</a>\n";
-    html << "</div>\n";
-    html << "</div></body></html>";
-    
-    return html.str();
 }
 
-std::string HttpServer::handleBookAppointment(const std::string& requestBody) {
-    std::string doctorIdStr = getFormValue(requestBody, "doctor_id");
-    int doctorId = std::stoi(doctorIdStr);
-    
-    auto doctor = getDoctorById(doctorId);
-    if (!doctor) {
-        return createHttpResponse(404, "<h1>Doctor not found</h1>");
-    }
-    
-    // If this is a booking confirmation (POST to /confirm-booking), write appointment to file
-    // Otherwise, show the booking form
-    if (requestBody.find("patient_name=") != std::string::npos) {
-        std::string patientName = getFormValue(requestBody, "patient_name");
-        std::string patientEmail = getFormValue(requestBody, "patient_email");
-        std::string patientPhone = getFormValue(requestBody, "patient_phone");
-        std::string appointmentDate = getFormValue(requestBody, "appointment_date");
-        std::string appointmentTime = getFormValue(requestBody, "appointment_time");
-        std::string appointmentType = getFormValue(requestBody, "appointment_type");
-        std::string notes = getFormValue(requestBody, "notes");
-        std::ostringstream details;
-        details << "Doctor: " << doctor->getName() << " (" << doctor->getSpecialty() << ")\n";
-        details << "Patient: " << patientName << "\n";
-        details << "Email: " << patientEmail << "\n";
-        details << "Phone: " << patientPhone << "\n";
-        details << "Date: " << appointmentDate << "\n";
-        details << "Time: " << appointmentTime << "\n";
-        details << "Type: " << appointmentType << "\n";
-        details << "Notes: " << notes << "\n";
-        details << "-----------------------------";
-        writeAppointmentToFile(details.str());
-        return createHttpResponse(200, "<html><body><h1> Appointment Booked Successfully!</h1><p>You will receive a confirmation email shortly.</p><a href='/'>← Back to Home</a></body></html>");
-    }
-    
-    // Generate booking form HTML
-    std::ostringstream html;
-    html << "<!DOCTYPE html>\n<html><head><title>Book Appointment - MediCare AI</title>\n";
-    html << "<style>\n";
-    html << "body { font-family: 'Segoe UI', sans-serif; background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); margin: 0; padding: 20px; }\n";
-    html << ".container { max-width: 800px; margin: 0 auto; }\n";
-    html << ".card { background: rgba(255,255,255,0.95); border-radius: 20px; padding: 40px; margin-bottom: 30px; box-shadow: 0 20px 40px rgba(0,0,0,0.1); }\n";
-    html << ".form-group { margin-bottom: 25px; }\n";
-    html << "label { display: block; margin-bottom: 8px; font-weight: 600; color: #374151; }\n";
-    html << "input, select, textarea { width: 100%; padding: 12px 16px; border: 2px solid #e5e7eb; border-radius: 10px; font-size: 16px; }\n";
-    html << ".btn { background: linear-gradient(45deg, #2563eb, #7c3aed); color: white; border: none; padding: 15px 30px; border-radius: 12px; font-size: 16px; font-weight: 600; cursor: pointer; width: 100%; }\n";
-    html << "</style></head><body>\n";
-    
-    html << "<div class='container'>\n";
-    html << "<div class='card'>\n";
-    html << "<h1> Book Appointment with " << doctor->getName() << "</h1>\n";
-    html << "<p><strong>Specialty:</strong> " << doctor->getSpecialty() << "</p>\n";
-    html << "<p><strong>Consultation Fee:</strong> PKR" << (doctor->getConsultationFee() / 100) << "</p>\n";
-    html << "<br>\n";
-    
-    html << "<form action='/book' method='POST'>\n";
-    html << "<input type='hidden' name='doctor_id' value='" << doctorId << "'>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Full Name *</label>\n";
-    html << "<input type='text' name='patient_name' required>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Email Address *</label>\n";
-    html << "<input type='email' name='patient_email' required>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Phone Number *</label>\n";
-    html << "<input type='tel' name='patient_phone' required>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Preferred Date *</label>\n";
-    html << "<input type='date' name='appointment_date' required>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Preferred Time *</label>\n";
-    html << "<select name='appointment_time' required>\n";
-    html << "<option value=''>Select time</option>\n";
-    html << "<option value='9:00 AM'>9:00 AM</option>\n";
-    html << "<option value='10:00 AM'>10:00 AM</option>\n";
-    html << "<option value='11:00 AM'>11:00 AM</option>\n";
-    html << "<option value='2:00 PM'>2:00 PM</option>\n";
-    html << "<option value='3:00 PM'>3:00 PM</option>\n";
-    html << "<option value='4:00 PM'>4:00 PM</option>\n";
-    html << "</select>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Appointment Type *</label>\n";
-    html << "<select name='appointment_type' required>\n";
-    html << "<option value='in-person'>In-Person Visit</option>\n";
-    html << "<option value='video'>Video Consultation</option>\n";
-    html << "</select>\n";
-    html << "</div>\n";
-    
-    html << "<div class='form-group'>\n";
-    html << "<label>Additional Notes</label>\n";
-    html << "<textarea name='notes' placeholder='Any specific concerns or information for the doctor...'></textarea>\n";
-    html << "</div>\n";
-    
-    html << "<button type='submit' class='btn'> Confirm Appointment</button>\n";
-    html << "</form>\n";
-    
-    html << "<br><a href='/' style='color: #2563eb;'>← Back to Home</a>\n";
-    html << "</div>\n";
-    html << "</div></body></html>";
-    
-    return html.str();
+void HttpServer::closeConnection(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    close(it->second->fd);
+    connections.erase(it);
+    openConnections->add(-1);
 }
 
-std::string HttpServer::createHttpResponse(int statusCode, const std::string& body, const std::string& contentType) {
-    std::ostringstream response;
-    response << "HTTP/1.1 " << statusCode << " OK\r\n";
-    response << "Content-Type: " << contentType << "\r\n";
-    response << "Content-Length: " << body.length() << "\r\n";
-    response << "Connection: close\r\n";
-    response << "\r\n";
-    response << body;
-    return response.str();
+void HttpServer::postCompletion(uint64_t connectionId, HttpResponse response, bool final) {
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        completions.push_back({connectionId, std::move(response), final});
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
 }
 
-bool HttpServer::start() {
-    running = true;
+// Rewrites "Connection: keep-alive" (and its Keep-Alive line) in a complete response's head
+static bool markConnectionClose(HttpResponse& response) {
+    std::string& bytes = response.bytes;
+    size_t headEnd = bytes.find("\r\n\r\n");
+    size_t start = bytes.find("\r\nConnection: keep-alive\r\n");
+    if (headEnd == std::string::npos || start == std::string::npos || start > headEnd) return false;
+    size_t end = start + std::strlen("\r\nConnection: keep-alive");
+    if (bytes.compare(end, 13, "\r\nKeep-Alive:") == 0) end = bytes.find("\r\n", end + 2);
+    bytes.replace(start, end - start, "\r\nConnection: close");
     return true;
 }
 
-void HttpServer::stop() {
-    running = false;
+void HttpServer::processCompletions() {
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        ready.swap(completions);
+    }
+
+    for (auto& completion : ready) {
+        auto it = connections.find(completion.connectionId);
+        if (it == connections.end()) continue; // client went away while the handler ran
+
+        Connection& conn = *it->second;
+        if (completion.final) conn.busy = false;
+        if (conn.outOffset >= conn.out.size()) {
+            // Rendered before a drain began: tell the client this connection ends with the response
+            if (!running && completion.final && markConnectionClose(completion.response)) {
+                conn.closeAfterWrite = true;
+            }
+            conn.out = std::move(completion.response);
+            conn.outOffset = 0;
+        } else {
+            // More of a streamed response while the previous piece is still draining;
+            // streamed pieces never carry a shared body, so appending keeps the order
+            conn.out.bytes += completion.response.bytes;
+        }
+        flushWrites(conn);
+    }
 }
 
 void HttpServer::run() {
-    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket < 0) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return;
-    }
-    
-    int opt = 1;
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    sockaddr_in serverAddr{};
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(port);
-    
-    if (bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        std::cerr << "Failed to bind socket" << std::endl;
-        close(serverSocket);
+    if (listenFd < 0) {
+        std::cerr << "run() called without a successful start()" << std::endl;
         return;
     }
-    
-    if (listen(serverSocket, 10) < 0) {
-        std::cerr << "Failed to listen on socket" << std::endl;
-        close(serverSocket);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        std::cerr << "Failed to create epoll instance" << std::endl;
+        close(listenFd);
+        listenFd = -1;
         return;
     }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = ListenerId;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.u64 = WakeId;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+    workerPool = std::make_unique<ThreadPool>(config.workerThreads);
     
     std::cout << " MediCare AI Server running on port " << port << std::endl;
     std::cout << " Visit: http://localhost:" << port << std::endl;
+    std::cout << " Workers: " << config.workerThreads << ", listen backlog: " << config.listenBacklog << std::endl;
     
-    while (running) {
-        sockaddr_in clientAddr{};
-        socklen_t clientLen = sizeof(clientAddr);
-        int clientSocket = accept(serverSocket, (sockaddr*)&clientAddr, &clientLen);
-        
-        if (clientSocket < 0) continue;
-        
-        char buffer[4096] = {0};
-        read(clientSocket, buffer, sizeof(buffer));
-        
-        std::string request(buffer);
-        std::string response;
-        
-        // Parse HTTP request
-        std::istringstream requestStream(request);
-        std::string method, path, version;
-        requestStream >> method >> path >> version;
-        
-        // Route handling
-        if (method == "GET" && path == "/") {
-            response = createHttpResponse(200, handleHomePage());
-        } else if (method == "POST" && path == "/analyze") {
-            size_t bodyStart = request.find("\r\n\r\n");
-            std::string body = (bodyStart != std::string::npos) ? request.substr(bodyStart + 4) : "";
-            response = createHttpResponse(200, handleAnalyzeSymptoms(body));
-        } else if (method == "POST" && path == "/book") {
-            size_t bodyStart = request.find("\r\n\r\n");
-            std::string body = (bodyStart != std::string::npos) ? request.substr(bodyStart + 4) : "";
-            response = createHttpResponse(200, handleBookAppointment(body));
-        } else if (method == "POST" && path == "/confirm-booking") {
-            response = createHttpResponse(200, "<html><body><h1> Appointment Booked Successfully!</h1><p>You will receive a confirmation email shortly.</p><a href='/'>← Back to Home</a></body></html>");
-        } else {
-            response = createHttpResponse(404, "<h1>404 - Page Not Found</h1>");
+    std::vector<epoll_event> events(config.maxEvents > 0 ? config.maxEvents : 256);
+    auto lastSweep = std::chrono::steady_clock::now();
+    bool draining = false;
+    auto drainDeadline = lastSweep;
+    for (;;) {
+        if (!running && !draining) {
+            std::cout << "\nShutting down MediCare AI server gracefully..." << std::endl;
+            draining = true;
+            drainDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.shutdownDrainMs);
+            beginDrain();
+        }
+        if (draining && (connections.empty() || std::chrono::steady_clock::now() >= drainDeadline)) break;
+        if (restartRequested.exchange(false) && running) spawnSuccessor();
+
+        // Wake up periodically while connections are open so idle ones can be reaped
+        int waitMs = draining ? 100 : connections.empty() ? -1 : IdleSweepIntervalMs;
+        int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), waitMs);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            uint32_t flags = events[i].events;
+
+            if (id == ListenerId) {
+                acceptConnections();
+                continue;
+            }
+            if (id == WakeId) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                processCompletions();
+                continue;
+            }
+
+            auto it = connections.find(id);
+            if (it == connections.end()) continue;
+            Connection& conn = *it->second;
+
+            if (flags & EPOLLERR) {
+                closeConnection(id);
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                handleReadable(conn);
+                if (connections.find(id) == connections.end()) continue;
+            }
+            if (flags & EPOLLOUT) {
+                flushWrites(conn);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (draining) {
+            // Keep-alive connections that stay quiet past the grace period will not send anything more
+            std::vector<uint64_t> done;
+            for (const auto& entry : connections) {
+                const Connection& conn = *entry.second;
+                if (!conn.busy && conn.out.empty() && conn.inBuffer.empty() &&
+                    now - conn.lastActivity >= std::chrono::milliseconds(DrainIdleGraceMs)) {
+                    done.push_back(entry.first);
+                }
+            }
+            for (uint64_t id : done) {
+                closeConnection(id);
+            }
+        } else if (now - lastSweep >= std::chrono::milliseconds(IdleSweepIntervalMs)) {
+            closeIdleConnections();
+            lastSweep = now;
+            // A successor that exits before taking over leaves us in charge; reap it and allow another try
+            int status;
+            if (successorPid > 0 && waitpid(successorPid, &status, WNOHANG) == successorPid) {
+                std::cerr << "Hot restart failed: process " << successorPid << " exited with status "
+                          << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << std::endl;
+                successorPid = 0;
+            }
         }
-        
-        write(clientSocket, response.c_str(), response.length());
-        close(clientSocket);
     }
     
-    close(serverSocket);
+    bool deadlinePassed = !connections.empty();
+    if (deadlinePassed) {
+        std::cerr << "Drain deadline passed; closing " << connections.size() << " connections" << std::endl;
+    }
+    // Bookings made while draining are committed before the file (and its lock) passes to a
+    // successor, which waits on the flock until then. Anything still queued after the deadline
+    // fails cleanly and the patient is asked to retry.
+    appointmentJournal.close();
+    // Past the deadline, requests still waiting for a worker are dropped with their connections;
+    // only handlers already running are waited for
+    workerPool->shutdown(deadlinePassed);
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->first);
+    }
+    close(epollFd);
+    epollFd = -1;
 }
 
 } // namespace MediCare
\ No newline at end of file
@@ -8,10 +8,78 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <chrono>
+#include <string_view>
+#include <future>
+#include <list>
+#include <optional>
+#include <shared_mutex>
+#include <initializer_list>
+#include <array>
 #include <curl/curl.h>
 
 namespace MediCare {
 
+// Value bound to a template placeholder; numbers are formatted straight into the output
+struct TemplateArg {
+    enum class Kind { Text, Integer, Decimal };
+
+    std::string_view name;
+    Kind kind;
+    std::string_view text;
+    long long integer = 0;
+    double decimal = 0;
+
+    TemplateArg(std::string_view name, std::string_view text) : name(name), kind(Kind::Text), text(text) {}
+    TemplateArg(std::string_view name, const char* text) : name(name), kind(Kind::Text), text(text) {}
+    TemplateArg(std::string_view name, int value) : name(name), kind(Kind::Integer), integer(value) {}
+    TemplateArg(std::string_view name, double value) : name(name), kind(Kind::Decimal), decimal(value) {}
+};
+
+// HTML template compiled once into literal slices and placeholders.
+// {{name}} is HTML-escaped; {{{name}}} inserts pre-rendered markup unchanged.
+class HtmlTemplate {
+private:
+    struct Segment {
+        uint32_t offset;  // into source
+        uint32_t length;
+        bool placeholder;
+        bool raw;
+    };
+
+    std::string source;
+    std::vector<Segment> segments;
+    size_t literalBytes = 0;
+
+public:
+    static std::shared_ptr<const HtmlTemplate> compile(std::string source, std::string& error);
+    static void appendEscaped(std::string& out, std::string_view text);
+
+    // Appends to out; placeholders without a matching arg render as nothing
+    void render(std::string& out, std::initializer_list<TemplateArg> args) const;
+    size_t sizeHint() const { return literalBytes; }
+};
+
+// Named templates loaded from a directory of *.html files at startup
+class TemplateLibrary {
+private:
+    std::unordered_map<std::string, std::shared_ptr<const HtmlTemplate>> templates;
+
+public:
+    // Returns the number of templates compiled; problems are reported through error
+    size_t load(const std::string& directory, std::string& error);
+    // Missing names resolve to an empty template so pages degrade rather than fail
+    const HtmlTemplate& get(const std::string& name) const;
+};
+
 // Doctor class with full OOP encapsulation
 class Doctor {
 private:
@@ -28,35 +96,120 @@ private:
     bool isAvailable;
 
 public:
-    // Constructor with initialization list
-    Doctor(int id, const std::string& name, const std::string& specialty,
-           int exp, double rat, int reviews, const std::string& bio,
-           int fee, const std::string& img, const std::vector<std::string>& specs)
-        : id(id), name(name), specialty(specialty), experience(exp), 
-          rating(rat), reviewCount(reviews), bio(bio), consultationFee(fee),
-          imageUrl(img), specializations(specs), isAvailable(true) {}
+    // Constructor with initialization list (sink arguments: pass temporaries to move them in)
+    Doctor(int id, std::string name, std::string specialty,
+           int exp, double rat, int reviews, std::string bio,
+           int fee, std::string img, std::vector<std::string> specs)
+        : id(id), name(std::move(name)), specialty(std::move(specialty)), experience(exp), 
+          rating(rat), reviewCount(reviews), bio(std::move(bio)), consultationFee(fee),
+          imageUrl(std::move(img)), specializations(std::move(specs)), isAvailable(true) {}
 
-    // Getters (const methods for data integrity)
+    // Getters (const methods for data integrity; references stay valid as long as the Doctor)
     int getId() const { return id; }
-    std::string getName() const { return name; }
-    std::string getSpecialty() const { return specialty; }
+    const std::string& getName() const { return name; }
+    const std::string& getSpecialty() const { return specialty; }
     int getExperience() const { return experience; }
     double getRating() const { return rating; }
     int getReviewCount() const { return reviewCount; }
-    std::string getBio() const { return bio; }
+    const std::string& getBio() const { return bio; }
     int getConsultationFee() const { return consultationFee; }
-    std::string getImageUrl() const { return imageUrl; }
-    std::vector<std::string> getSpecializations() const { return specializations; }
+    const std::string& getImageUrl() const { return imageUrl; }
+    const std::vector<std::string>& getSpecializations() const { return specializations; }
     bool getIsAvailable() const { return isAvailable; }
 
     // Polymorphic behavior for specialization matching
-    virtual bool hasSpecialization(const std::string& spec) const;
-    virtual std::string toHtmlCard(bool isRecommended = false) const;
+    virtual bool hasSpecialization(std::string_view spec) const;
+    // Appends the doctor_card template; nextSlots holds (YYYY-MM-DD, "9:00 AM") pairs
+    // rendered as one-click booking buttons
+    virtual void renderHtmlCard(const TemplateLibrary& templates, std::string& out, bool isRecommended = false,
+                                const std::vector<std::pair<std::string, std::string>>& nextSlots = {}) const;
     
     // Virtual destructor for proper inheritance
     virtual ~Doctor() = default;
 };
 
+// Inverted index from interned specialty terms to doctors, built once per roster.
+// Doctors are numbered by rank (rating, then review count), so posting lists merge in rank order.
+class SpecialtyIndex {
+private:
+    std::vector<std::shared_ptr<Doctor>> ranked;
+    std::unordered_map<int, uint32_t> rankById;
+    std::vector<std::string> terms;                 // lowercased specialty and specialization names
+    std::vector<std::vector<uint32_t>> postings;    // term id -> sorted doctor ranks
+    std::unordered_map<std::string, std::vector<uint32_t>> termMatches; // vocabulary term -> matching term ids
+
+    // Term ids matching query; queries that are not vocabulary terms are resolved into scratch
+    const std::vector<uint32_t>& resolve(const std::string& query, std::vector<uint32_t>& scratch) const;
+
+public:
+    void build(const std::vector<std::shared_ptr<Doctor>>& doctors);
+
+    std::shared_ptr<Doctor> findById(int id) const;
+    // Same matching rule as Doctor::hasSpecialization (substring either way), case-insensitive
+    std::vector<std::shared_ptr<Doctor>> lookup(const std::string& specialty) const;
+    // Union over several specialties: doctors matching more of them first, then by rank
+    std::vector<std::shared_ptr<Doctor>> lookupAny(const std::vector<std::string>& specialties, size_t limit) const;
+    size_t size() const { return ranked.size(); }
+};
+
+// Read-only view of one fixed-width record in a mapped roster file
+class DoctorRecordView {
+private:
+    const char* record;
+    std::string_view strings; // the roster's string table
+
+    std::string_view stringAt(size_t fieldOffset) const;
+
+public:
+    DoctorRecordView(const char* record, std::string_view strings) : record(record), strings(strings) {}
+
+    int getId() const;
+    int getExperience() const;
+    double getRating() const;
+    int getReviewCount() const;
+    int getConsultationFee() const;
+    std::string_view getName() const { return stringAt(20); }
+    std::string_view getSpecialty() const { return stringAt(28); }
+    std::string_view getBio() const { return stringAt(36); }
+    std::string_view getImageUrl() const { return stringAt(44); }
+    std::string_view getSpecializationList() const { return stringAt(52); } // ';'-separated
+};
+
+// Binary doctor roster: header, fixed-width records, then one shared string table.
+// The file is mapped only while a DoctorDirectory is built from it.
+class DoctorRoster {
+private:
+    void* mapping;
+    size_t mappingSize;
+    uint32_t recordCount;
+    const char* records;
+    std::string_view strings;
+
+    DoctorRoster() : mapping(nullptr), mappingSize(0), recordCount(0), records(nullptr) {}
+
+public:
+    static const size_t HeaderBytes = 16;
+    static const size_t RecordBytes = 60;
+
+    ~DoctorRoster();
+    DoctorRoster(const DoctorRoster&) = delete;
+    DoctorRoster& operator=(const DoctorRoster&) = delete;
+
+    // Maps and validates the file (string bounds, unique ids); nullptr (with a reason) if it is missing or malformed
+    static std::shared_ptr<const DoctorRoster> open(const std::string& path, std::string& error);
+    // Compiles a tab-separated roster (see doctors.tsv) and atomically replaces outputPath
+    static bool compile(const std::string& tsvPath, const std::string& outputPath, std::string& error);
+
+    size_t size() const { return recordCount; }
+    DoctorRecordView at(size_t index) const { return DoctorRecordView(records + index * RecordBytes, strings); }
+};
+
+// Immutable doctor snapshot swapped as a unit when the roster file changes
+struct DoctorDirectory {
+    std::vector<std::shared_ptr<Doctor>> doctors;
+    SpecialtyIndex specialtyIndex;
+};
+
 // Appointment class with encapsulation
 class Appointment {
 private:
@@ -73,25 +226,58 @@ private:
     std::string status;
 
 public:
-    Appointment(int id, int docId, const std::string& name, const std::string& email,
-                const std::string& phone, const std::string& date, const std::string& time,
-                const std::string& type, const std::string& symp, const std::string& note)
-        : id(id), doctorId(docId), patientName(name), patientEmail(email),
-          patientPhone(phone), appointmentDate(date), appointmentTime(time),
-          appointmentType(type), symptoms(symp), notes(note), status("scheduled") {}
+    Appointment(int id, int docId, std::string name, std::string email,
+                std::string phone, std::string date, std::string time,
+                std::string type, std::string symp, std::string note)
+        : id(id), doctorId(docId), patientName(std::move(name)), patientEmail(std::move(email)),
+          patientPhone(std::move(phone)), appointmentDate(std::move(date)), appointmentTime(std::move(time)),
+          appointmentType(std::move(type)), symptoms(std::move(symp)), notes(std::move(note)), status("scheduled") {}
 
     // Getters
     int getId() const { return id; }
     int getDoctorId() const { return doctorId; }
-    std::string getPatientName() const { return patientName; }
-    std::string getStatus() const { return status; }
+    const std::string& getPatientName() const { return patientName; }
+    const std::string& getPatientEmail() const { return patientEmail; }
+    const std::string& getPatientPhone() const { return patientPhone; }
+    const std::string& getAppointmentDate() const { return appointmentDate; }
+    const std::string& getAppointmentTime() const { return appointmentTime; }
+    const std::string& getAppointmentType() const { return appointmentType; }
+    const std::string& getSymptoms() const { return symptoms; }
+    const std::string& getNotes() const { return notes; }
+    const std::string& getStatus() const { return status; }
     
     // Status management
-    void setStatus(const std::string& newStatus) { status = newStatus; }
+    void setStatus(std::string newStatus) { status = std::move(newStatus); }
     
     virtual ~Appointment() = default;
 };
 
+// Single-pass converter for the Markdown subset Gemini answers use: headings, nested
+// bullet/numbered lists, paragraphs, **bold**, *emphasis* and `code`. All text is
+// HTML-escaped. Input may arrive in arbitrary chunks; only complete lines are emitted.
+class MarkdownRenderer {
+private:
+    struct OpenList {
+        size_t indent;
+        bool ordered;
+    };
+
+    std::string pendingLine;        // partial line carried between feed() calls
+    std::vector<OpenList> lists;    // innermost last; its <li> is still open
+    bool inParagraph = false;
+
+    void renderLine(std::string_view line, std::string& out);
+    void closeParagraph(std::string& out);
+    void closeListsDeeperThan(size_t indent, std::string& out);
+    static void renderInline(std::string_view text, std::string& out);
+
+public:
+    void feed(std::string_view text, std::string& out);
+    void finish(std::string& out); // flushes the last line and closes open blocks
+
+    static void render(std::string_view markdown, std::string& out);
+};
+
 // AI Analysis class with abstraction
 class SymptomAnalysis {
 public:
@@ -100,8 +286,8 @@ public:
         std::string description;
         int confidence;
         
-        Condition(const std::string& c, const std::string& d, int conf)
-            : condition(c), description(d), confidence(conf) {}
+        Condition(std::string c, std::string d, int conf)
+            : condition(std::move(c)), description(std::move(d)), confidence(conf) {}
     };
 
 private:
@@ -114,87 +300,1157 @@ private:
     std::vector<std::string> suggestedSpecialties;
     std::string rawAIResponse; // Store the raw AI response
     std::string mainAIText;    // Store the extracted main AI text
+    long promptTokens = 0;     // Gemini usageMetadata, 0 when unknown
+    long outputTokens = 0;
+
+public:
+    // Who wrote mainAIText. Rules means nobody did: only the rule-based assessment is available.
+    enum class AnswerSource { Rules, Gemini, TriageModel, TriageFallback };
+
+private:
+    AnswerSource answerSource = AnswerSource::Rules;
 
 public:
     SymptomAnalysis(const std::string& symp, const std::string& dur, int sev)
         : symptoms(symp), duration(dur), severity(sev) {}
 
     // Data management methods
-    void addCondition(const std::string& condition, const std::string& description, int confidence);
-    void addRecommendation(const std::string& recommendation);
-    void addWarningSign(const std::string& warning);
-    void addSuggestedSpecialty(const std::string& specialty);
+    void addCondition(std::string condition, std::string description, int confidence);
+    void addRecommendation(std::string recommendation);
+    void addWarningSign(std::string warning);
+    void addSuggestedSpecialty(std::string specialty);
 
     // Getters
-    std::vector<std::string> getSuggestedSpecialties() const { return suggestedSpecialties; }
-    void setRawAIResponse(const std::string& raw) { rawAIResponse = raw; }
-    std::string getRawAIResponse() const { return rawAIResponse; }
-    void setMainAIText(const std::string& text) { mainAIText = text; }
-    std::string getMainAIText() const { return mainAIText; }
+    const std::vector<Condition>& getPossibleConditions() const { return possibleConditions; }
+    const std::vector<std::string>& getRecommendations() const { return recommendations; }
+    const std::vector<std::string>& getWarningSigns() const { return warningSignsWarnings; }
+    const std::vector<std::string>& getSuggestedSpecialties() const { return suggestedSpecialties; }
+    void setRawAIResponse(std::string raw) { rawAIResponse = std::move(raw); }
+    const std::string& getRawAIResponse() const { return rawAIResponse; }
+    void setMainAIText(std::string text) { mainAIText = std::move(text); }
+    const std::string& getMainAIText() const { return mainAIText; }
+    void setTokenUsage(long prompt, long output) { promptTokens = prompt; outputTokens = output; }
+    long getPromptTokens() const { return promptTokens; }
+    long getOutputTokens() const { return outputTokens; }
+    void setAnswerSource(AnswerSource source) { answerSource = source; }
+    AnswerSource getAnswerSource() const { return answerSource; }
+    // Stand-in answers given because Gemini failed; worth retrying rather than caching
+    bool isDegraded() const {
+        return mainAIText.empty() || answerSource == AnswerSource::Rules || answerSource == AnswerSource::TriageFallback;
+    }
 
     // HTML generation for display
-    std::string toHtmlResults(bool showRaw = false) const;
+    // includeMainText=false leaves out the AI answer box (the streaming page sends it separately)
+    void renderHtmlResults(const TemplateLibrary& templates, std::string& out, bool includeMainText = true) const;
     
     virtual ~SymptomAnalysis() = default;
 };
 
+// Metrics: recording is a relaxed atomic add on a per-thread shard, so hot paths never lock
+// or bounce a shared cache line. Only registration and scraping take the registry mutex.
+constexpr size_t MetricShards = 8;
+size_t metricShardIndex(); // stable per thread
+
+class Counter {
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, MetricShards> shards;
+
+public:
+    void add(uint64_t amount = 1) { shards[metricShardIndex()].value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t value() const;
+};
+
+class Gauge {
+private:
+    std::atomic<int64_t> current{0};
+
+public:
+    void add(int64_t delta) { current.fetch_add(delta, std::memory_order_relaxed); }
+    void set(int64_t value) { current.store(value, std::memory_order_relaxed); }
+    int64_t value() const { return current.load(std::memory_order_relaxed); }
+};
+
+// Log-linear buckets in the HDR histogram style: exact below 16, then 8 buckets per power of two,
+// so any recorded value is known to within 12.5%. Values are integers (microseconds or counts).
+class Histogram {
+public:
+    enum class Unit { Seconds, Count }; // Seconds: record microseconds, export seconds
+
+    static constexpr size_t BucketCount = 16 + 36 * 8; // up to 2^40 - 1
+    static size_t bucketFor(uint64_t value);
+    static uint64_t bucketUpperBound(size_t bucket); // largest value that lands in the bucket
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t quantile(double fraction) const; // upper bound of the bucket holding that rank
+    };
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, BucketCount> buckets{};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::unique_ptr<Shard[]> shards;
+    Unit unit;
+
+public:
+    explicit Histogram(Unit unit = Unit::Seconds);
+
+    void record(uint64_t value) {
+        Shard& shard = shards[metricShardIndex()];
+        shard.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+    void recordDuration(std::chrono::steady_clock::duration elapsed) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        record(micros > 0 ? static_cast<uint64_t>(micros) : 0);
+    }
+    Snapshot snapshot() const;
+    Unit getUnit() const { return unit; }
+};
+
+// Named metric families with pre-formatted label sets, exported in the Prometheus text format.
+// Instruments are registered up front and live as long as the registry.
+class MetricsRegistry {
+private:
+    struct Series {
+        std::string labels; // e.g. route="/analyze"
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> read; // sampled at scrape time
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        std::string type; // "counter", "gauge" or "histogram"
+        std::vector<Series> series;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Family>> families;
+
+    // Finds or creates a series; the caller holds mutex
+    Series& series(const std::string& name, const std::string& help, const char* type, const std::string& labels);
+
+public:
+    // Registering an existing name and label set returns the same instrument
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         Histogram::Unit unit = Histogram::Unit::Seconds);
+    // Values owned elsewhere (cache statistics, breaker state); type is "counter" or "gauge"
+    void callback(const std::string& name, const std::string& help, const char* type, std::function<double()> read,
+                  const std::string& labels = "");
+
+    std::string render() const;
+};
+
+// Outcome of one upstream HTTP call
+struct AIHttpResult {
+    bool ok = false;          // transfer completed with a 2xx status
+    long httpStatus = 0;
+    std::string body;
+    std::string error;
+    double elapsedMs = 0;
+};
+
+// Push (SAX-style) JSON parser: bytes can be fed in arbitrary pieces as they arrive and
+// events fire as soon as each token is complete. String views passed to the handler point
+// into a reused scratch buffer and are only valid during the call.
+class JsonStreamParser {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual void startObject() {}
+        virtual void endObject() {}
+        virtual void startArray() {}
+        virtual void endArray() {}
+        virtual void key(std::string_view) {}
+        virtual void stringValue(std::string_view) {}
+        virtual void numberValue(std::string_view) {} // raw token text
+        virtual void literalValue(std::string_view) {} // true, false or null
+    };
+
+private:
+    enum class State { Value, ArrayValueOrEnd, ObjectKeyOrEnd, ObjectKey, Colon, AfterValue, String, Number, Literal, Done };
+
+    Handler& handler;
+    State state;
+    std::vector<char> containers;   // '{' or '[' per open level
+    std::string scratch;            // current string, number or literal
+    bool readingKey;
+    bool escaped;
+    int unicodeDigits;              // remaining hex digits of a \u escape
+    uint32_t unicodeValue;
+    uint32_t highSurrogate;
+    std::string error;
+
+    bool fail(const char* message);
+    void valueFinished();
+    void appendCodePoint(uint32_t codePoint);
+    bool feedStringByte(char c);
+
+public:
+    explicit JsonStreamParser(Handler& handler);
+
+    // Returns false once the input is malformed; later calls are ignored
+    bool feed(std::string_view bytes);
+    bool finish(); // true if exactly one complete top-level value was seen
+    bool failed() const { return !error.empty(); }
+    const std::string& getError() const { return error; }
+};
+
+// Streaming JSON writer that appends to a caller-owned buffer (reuse it to avoid reallocating).
+// Commas and string escaping are handled here; nesting is the caller's responsibility.
+class JsonWriter {
+private:
+    std::string& out;
+    std::vector<bool> hasMembers; // per open container
+    bool afterKey = false;
+
+    void separate();
+
+public:
+    explicit JsonWriter(std::string& out) : out(out) {}
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+    JsonWriter& key(std::string_view name);
+    JsonWriter& value(std::string_view text);
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(long long number);
+    JsonWriter& value(int number) { return value(static_cast<long long>(number)); }
+    JsonWriter& value(double number);
+    JsonWriter& value(bool flag);
+    JsonWriter& raw(std::string_view json); // pre-serialized value
+
+    // Escapes for use inside a JSON string; invalid UTF-8 becomes U+FFFD
+    static void appendEscaped(std::string& out, std::string_view text);
+};
+
+// Request shape for Gemini calls; the prompt template may use {{symptoms}}, {{duration}} and {{severity}}
+struct GeminiPromptOptions {
+    std::string systemInstruction =
+        "You are a careful medical triage assistant. You do not diagnose; you describe possible "
+        "conditions, practical self-care, warning signs that need urgent care, and which medical "
+        "specialties are relevant. Answer in concise Markdown.";
+    std::string promptTemplate =
+        "As a medical AI assistant, analyze these symptoms:\n\n"
+        "Symptoms: {{symptoms}}\n"
+        "Duration: {{duration}}\n"
+        "Severity (1-10): {{severity}}\n\n"
+        "Provide analysis with possible conditions, recommendations, warning signs, and suggested specialties.";
+    double temperature = 0.4;
+    double topP = 0.95;
+    int maxOutputTokens = 1024;
+};
+
+// How the Gemini call copes with a slow or failing upstream
+struct GeminiResilienceOptions {
+    int maxAttempts = 2;              // 1 disables retries
+    long retryBaseDelayMs = 200;      // backoff before attempt n is uniform in [0, base * 2^(n-2)]
+    long minAttemptMs = 250;          // an attempt needs at least this much of the deadline left
+    size_t breakerWindow = 20;        // recent outcomes the circuit breaker looks at
+    size_t breakerMinRequests = 10;   // never trip on fewer outcomes than this
+    double breakerFailureRatio = 0.5; // trip once this share of the window failed
+    long breakerOpenMs = 15000;       // a tripped breaker rejects calls this long, then lets one probe through
+    bool hedgeRequests = false;       // send a duplicate when the first is slower than the recent p95
+    size_t hedgeMinSamples = 20;      // latencies needed before the p95 is trusted
+};
+
+// Gemini request body compiled once: everything but the user's fields is pre-serialized,
+// so a request is a handful of appends plus escaping of the user text
+class GeminiPayloadBuilder {
+private:
+    enum Field { Literal, Symptoms, Duration, Severity };
+    struct Segment {
+        Field field;
+        std::string text; // already JSON-escaped when field == Literal
+    };
+
+    std::string head;   // everything up to the opening quote of the prompt text
+    std::string tail;   // from its closing quote to the end
+    std::vector<Segment> prompt;
+    size_t fixedBytes = 0;
+
+public:
+    explicit GeminiPayloadBuilder(const GeminiPromptOptions& options = GeminiPromptOptions());
+
+    std::string build(std::string_view symptoms, std::string_view duration, int severity) const;
+};
+
+// Everything we use from a Gemini generateContent reply (or a streamed array of them)
+struct GeminiReply {
+    std::string text;           // all candidates[].content.parts[].text, in order
+    long promptTokens = 0;      // usageMetadata
+    long candidateTokens = 0;
+    long totalTokens = 0;
+    std::string apiError;       // error.message when the API rejected the call
+};
+
+// Fills a GeminiReply from JSON events; onText sees each text part as soon as it is parsed
+class GeminiReplyParser : public JsonStreamParser::Handler {
+private:
+    GeminiReply& reply;
+    std::function<void(std::string_view)> onText;
+    std::vector<std::string> path; // "{}"/"[]" per open container, preceded by its key
+    std::string pendingKey;
+
+    void enter(const char* marker);
+    void leave();
+    bool pathEndsWith(std::initializer_list<const char*> suffix) const;
+
+public:
+    explicit GeminiReplyParser(GeminiReply& reply, std::function<void(std::string_view)> onText = nullptr)
+        : reply(reply), onText(std::move(onText)) {}
+
+    void startObject() override { enter("{}"); }
+    void endObject() override { leave(); }
+    void startArray() override { enter("[]"); }
+    void endArray() override { leave(); }
+    void key(std::string_view name) override { pendingKey.assign(name); }
+    void stringValue(std::string_view value) override;
+    void numberValue(std::string_view value) override;
+    void literalValue(std::string_view) override { pendingKey.clear(); }
+};
+
+// Multiplexed HTTP client on the curl multi interface. One background thread drives every
+// transfer; easy handles are pooled so connections and TLS sessions stay warm between calls.
+class AsyncAIClient {
+public:
+    using Callback = std::function<void(AIHttpResult)>;
+    using DataCallback = std::function<void(std::string_view)>;
+    using CancelToken = std::shared_ptr<std::atomic<bool>>;
+
+private:
+    struct Transfer {
+        CURL* easy = nullptr;
+        std::string url;
+        std::string payload;
+        long timeoutMs = 0;
+        Callback callback;
+        DataCallback onData;      // sees body bytes as they arrive, on the client thread
+        CancelToken cancel;       // set (then wake the loop) to abort the transfer
+        AIHttpResult result;
+        std::chrono::steady_clock::time_point startedAt;
+        char errorBuffer[CURL_ERROR_SIZE] = {0};
+    };
+
+    CURLM* multi;
+    CURLSH* share;            // DNS cache and TLS sessions shared by all pooled handles
+    curl_slist* jsonHeaders;
+    size_t maxPooledHandles;
+    std::vector<CURL*> idleHandles;   // loop thread only
+    std::vector<CURL*> activeHandles; // loop thread only
+    std::mutex mutex;
+    std::deque<std::unique_ptr<Transfer>> pending;
+    bool stopping;
+    std::thread loopThread;
+
+    static size_t writeBody(void* contents, size_t size, size_t nmemb, void* userp);
+    CURL* acquireHandle();
+    void releaseHandle(CURL* easy);
+    void startPending();
+    void finishTransfer(CURL* easy, CURLcode code);
+    void abortCancelled();
+    void eventLoop();
+
+public:
+    explicit AsyncAIClient(size_t maxPooledHandles = 16);
+    ~AsyncAIClient();
+
+    AsyncAIClient(const AsyncAIClient&) = delete;
+    AsyncAIClient& operator=(const AsyncAIClient&) = delete;
+
+    // POST a JSON payload; the callbacks run on the client thread and must not block.
+    // onData, if set, sees body bytes as they arrive (the full body is still collected).
+    void post(const std::string& url, std::string payload, long timeoutMs, Callback callback,
+              DataCallback onData = nullptr, CancelToken cancel = nullptr);
+    std::future<AIHttpResult> post(const std::string& url, std::string payload, long timeoutMs,
+                                   DataCallback onData = nullptr);
+    // Aborts the transfer posted with this token; its callback still runs, with an error
+    void cancel(const CancelToken& token);
+};
+
+// Trips when too many recent upstream calls failed. While open, callers skip the upstream;
+// after a cool-down a single probe call decides whether it closes again.
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+private:
+    std::mutex mutex;
+    State state;
+    std::vector<char> outcomes; // ring of recent results, 1 = failure
+    size_t nextOutcome;
+    size_t recorded;
+    size_t failures;
+    size_t minRequests;
+    double failureRatio;
+    std::chrono::milliseconds openFor;
+    std::chrono::steady_clock::time_point openedAt;
+    bool probeInFlight;
+
+    void resetWindow();
+
+public:
+    CircuitBreaker(size_t window, size_t minRequests, double failureRatio, std::chrono::milliseconds openFor);
+
+    // False while open; once the cool-down is over, true for exactly one probe caller
+    bool allowRequest();
+    void record(bool success);
+    State getState();
+};
+
+// Recent upstream latencies; the p95 is the hedging threshold
+class LatencyWindow {
+private:
+    std::mutex mutex;
+    std::vector<double> samples;
+    size_t capacity;
+    size_t nextSample;
+
+public:
+    explicit LatencyWindow(size_t capacity = 256);
+    void add(double ms);
+    // nullopt until minSamples latencies were recorded
+    std::optional<double> percentile(double fraction, size_t minSamples);
+};
+
+// Keyword rules compiled into one Aho-Corasick automaton, so classifying a text is a single
+// pass however many rules there are. Matching is ASCII case-folded and whole-word.
+class SymptomClassifier {
+public:
+    struct Rule {
+        std::string condition;
+        std::string description;
+        int confidence;
+        std::vector<std::string> specialties;
+    };
+
+    struct ConditionScore {
+        const Rule* rule;
+        double score;
+        int confidence; // rule confidence, raised by 5 per point of score above 1 (at most 95)
+    };
+
+    struct Classification {
+        std::vector<ConditionScore> conditions;                   // score >= 1, best first
+        std::vector<std::pair<std::string, double>> specialties;  // summed over those conditions, best first
+    };
+
+    static constexpr double SymptomWeight = 1.0; // patient's own words
+    static constexpr double AITextWeight = 0.5;  // mentions in the AI answer
+
+private:
+    struct Keyword {
+        uint32_t rule;
+        uint32_t length;
+        double weight;
+        bool prefix; // "word*": no boundary needed after the match
+    };
+
+    std::vector<Rule> rules;
+    std::vector<Keyword> keywords;
+    uint8_t byteClass[256] = {0};     // folded byte -> alphabet class (0: not in any keyword)
+    uint32_t classCount = 1;
+    std::vector<uint32_t> transitions; // state * classCount + class -> next state (complete DFA)
+    std::vector<std::vector<uint32_t>> outputs; // state -> keywords ending here (suffix matches included)
+
+    void scan(std::string_view text, std::vector<char>& matched) const;
+
+public:
+    // Reads a rule table (see symptom_rules.tsv); nullptr with a reason on failure
+    static std::shared_ptr<const SymptomClassifier> load(const std::string& path, std::string& error);
+    static std::shared_ptr<const SymptomClassifier> compile(std::vector<Rule> rules,
+                                                           const std::vector<std::vector<std::string>>& ruleKeywords,
+                                                           std::string& error);
+
+    Classification classify(std::string_view symptoms, std::string_view aiText) const;
+    size_t ruleCount() const { return rules.size(); }
+    size_t stateCount() const { return outputs.size(); }
+};
+
+// Offline triage: a bag-of-words linear model (unigrams and bigrams) over the symptom text,
+// read from a model file. Predicting is a few hash lookups and a softmax.
+class TriageModel {
+public:
+    struct Label {
+        std::string condition;
+        std::string description;
+        std::string advice; // Markdown shown as the answer text
+        std::vector<std::string> specialties;
+    };
+
+    struct Prediction {
+        const Label* label;
+        double probability;
+    };
+
+private:
+    std::vector<Label> labels;
+    std::vector<double> bias;                              // per label
+    std::unordered_map<std::string, uint32_t> vocabulary;  // feature -> row in weights
+    std::vector<double> weights;                           // row * labels.size() + label
+
+public:
+    // Reads a model file (see triage.model); nullptr with a reason on failure
+    static std::shared_ptr<const TriageModel> load(const std::string& path, std::string& error);
+
+    Prediction predict(std::string_view text) const;
+    size_t labelCount() const { return labels.size(); }
+    size_t featureCount() const { return vocabulary.size(); }
+};
+
+struct GeminiAttempt; // one in-flight POST with its own reply parser
+
 // AI Service with inheritance and polymorphism
 class AIService {
+public:
+    using TextCallback = std::function<void(std::string_view)>;
+    using Deadline = std::chrono::steady_clock::time_point; // the whole analysis must be done by then
+
 private:
     std::string apiKey;
-    CURL* curl;
-    
-    struct WriteCallback {
-        std::string data;
-    };
+    std::string baseUrl; // model URL; ":generateContent" or ":streamGenerateContent" is appended
+    GeminiPayloadBuilder payloadBuilder;
+    std::shared_ptr<const SymptomClassifier> classifier; // may be null: only the fallback assessment applies
+    long requestTimeoutMs;
+    GeminiResilienceOptions resilience;
+    CircuitBreaker breaker;
+    LatencyWindow latencies;
+    std::unique_ptr<AsyncAIClient> client;
+
+    // Null until attachMetrics
+    Histogram* geminiSuccessLatency = nullptr;
+    Histogram* geminiFailureLatency = nullptr;
+    Counter* geminiRetries = nullptr;
+    Counter* geminiHedges = nullptr;
+    Counter* geminiBreakerRejections = nullptr;
+    Counter* geminiDeadlineRejections = nullptr;
     
-    static size_t WriteCallbackFunction(void* contents, size_t size, size_t nmemb, WriteCallback* userp);
-    std::string makeHttpRequest(const std::string& url, const std::string& payload);
+    // Parses the reply while it downloads; returns false (and logs) on transport or API errors.
+    // Retries with jittered backoff inside the deadline unless the breaker is open.
+    bool requestGemini(const std::string& url, const std::string& payload, GeminiReply& reply, std::string& rawBody,
+                       TextCallback onText, Deadline deadline);
+    // One attempt, plus a hedged duplicate if hedgeAfterMs is set and the first is slower than that
+    std::unique_ptr<GeminiAttempt> sendAttempt(const std::string& url, const std::string& payload, long timeoutMs,
+                                               std::optional<double> hedgeAfterMs, const TextCallback& onText);
+    std::unique_ptr<SymptomAnalysis> runAnalysis(const std::string& symptoms, const std::string& duration,
+                                                 int severity, bool stream, TextCallback onText, Deadline deadline);
+
+protected:
+    // Rule-based conditions, specialties, recommendations and warning signs; skips conditions already present
+    void addAssessment(SymptomAnalysis& analysis, const std::string& symptoms) const;
 
 public:
-    AIService(const std::string& key);
+    AIService(const std::string& key, const std::string& baseUrl,
+              const GeminiPromptOptions& promptOptions = GeminiPromptOptions(),
+              std::shared_ptr<const SymptomClassifier> classifier = nullptr, long requestTimeoutMs = 30000,
+              const GeminiResilienceOptions& resilience = GeminiResilienceOptions());
     virtual ~AIService();
     
     // Pure virtual method for analysis (can be overridden for different AI services)
     virtual std::unique_ptr<SymptomAnalysis> analyzeSymptoms(const std::string& symptoms, 
                                                             const std::string& duration, 
-                                                            int severity);
+                                                            int severity, Deadline deadline);
+    // Same analysis via streamGenerateContent; onText receives the answer text as it is generated
+    // (on the transfer thread, so it must not block)
+    virtual std::unique_ptr<SymptomAnalysis> streamSymptoms(const std::string& symptoms,
+                                                           const std::string& duration,
+                                                           int severity, TextCallback onText, Deadline deadline);
+    CircuitBreaker::State getBreakerState() { return breaker.getState(); }
+    // Registers upstream latency, retry, hedge and breaker metrics; call once before serving
+    virtual void attachMetrics(MetricsRegistry& metrics);
+};
+
+// Answers confident cases from the local triage model without a network call, and falls back to
+// it when Gemini fails or times out, so /analyze latency does not depend on upstream health
+class HybridAIService : public AIService {
+private:
+    std::shared_ptr<const TriageModel> model;
+    double fastPathProbability; // above 1 disables the fast path; the model is then only a fallback
+    Counter* fastPathAnswers = nullptr;
+    Counter* fallbackAnswers = nullptr;
+
+    std::unique_ptr<SymptomAnalysis> localAnalysis(const std::string& symptoms, const std::string& duration,
+                                                   int severity, const TriageModel::Prediction& prediction,
+                                                   bool fallback, std::string answerPrefix) const;
+
+public:
+    HybridAIService(const std::string& key, const std::string& baseUrl, const GeminiPromptOptions& promptOptions,
+                    std::shared_ptr<const SymptomClassifier> classifier, long requestTimeoutMs,
+                    const GeminiResilienceOptions& resilience,
+                    std::shared_ptr<const TriageModel> model, double fastPathProbability);
+
+    std::unique_ptr<SymptomAnalysis> analyzeSymptoms(const std::string& symptoms, const std::string& duration,
+                                                    int severity, Deadline deadline) override;
+    std::unique_ptr<SymptomAnalysis> streamSymptoms(const std::string& symptoms, const std::string& duration,
+                                                   int severity, TextCallback onText, Deadline deadline) override;
+    void attachMetrics(MetricsRegistry& metrics) override;
+};
+
+// Bounded LRU cache of analyses keyed by normalized (symptoms, duration, severity).
+// Concurrent misses for the same key share a single upstream call.
+class AnalysisCache {
+public:
+    using AnalysisPtr = std::shared_ptr<const SymptomAnalysis>;
+    using Loader = std::function<std::unique_ptr<SymptomAnalysis>()>;
+
+private:
+    struct Entry {
+        std::string key;
+        AnalysisPtr value;
+        std::chrono::steady_clock::time_point expiresAt;
+    };
+
+    size_t capacity;
+    std::chrono::steady_clock::duration ttl;
+    std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::unordered_map<std::string, std::shared_future<AnalysisPtr>> inFlight;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> coalesced;
+
+    void insert(const std::string& key, const AnalysisPtr& value);
+
+public:
+    AnalysisCache(size_t capacity, std::chrono::seconds ttl);
+
+    static std::string makeKey(const std::string& symptoms, const std::string& duration, int severity);
+
+    // Returns the cached analysis or runs the loader; failed upstream answers are not cached
+    AnalysisPtr getOrCompute(const std::string& symptoms, const std::string& duration, int severity,
+                             const Loader& loader);
+
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+    uint64_t getCoalesced() const { return coalesced; }
+    size_t size();
+};
+
+// Append-only appointment log. Records are framed as [magic][length][crc32][payload]; a
+// dedicated writer thread batches queued bookings into one write + fdatasync (group commit).
+class AppointmentJournal {
+private:
+    struct PendingRecord {
+        std::string frame;
+        std::promise<bool> durable;
+    };
+
+    std::string path;
+    int fd;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable drained;
+    std::deque<PendingRecord> queue;
+    bool stopping;
+    bool writing;
+    bool failed; // a batch could not be rolled back; the file may not match what callers were told
+    std::atomic<uint64_t> recordCount;
+    std::atomic<uint64_t> commitCount;
+    Histogram* commitLatency = nullptr; // writev + fdatasync per group commit
+    Histogram* commitBatchSize = nullptr;
+    std::thread writerThread;
+
+    void writerLoop();
+
+public:
+    explicit AppointmentJournal(const std::string& path);
+    ~AppointmentJournal();
+
+    AppointmentJournal(const AppointmentJournal&) = delete;
+    AppointmentJournal& operator=(const AppointmentJournal&) = delete;
+
+    // Recovery scan: returns every intact record and truncates a torn or corrupt tail.
+    // Takes an exclusive lock first, so a restarted server waits for its predecessor's close().
+    bool open(std::vector<Appointment>& recovered);
+    void close(); // drains the queue, then stops the writer
+
+    // Resolves to true once the record is on stable storage
+    std::future<bool> append(const Appointment& appointment);
+    void flush(); // blocks until everything queued so far is durable
+
+    uint64_t getRecordCount() const { return recordCount; }
+    uint64_t getCommitCount() const { return commitCount; }
+    void attachMetrics(MetricsRegistry& metrics); // before open()
+
+    static std::string encode(const Appointment& appointment);
+    static std::optional<Appointment> decode(std::string_view payload);
+};
+
+// In-memory appointment index rebuilt from the journal. Each doctor has a bitmap of booked
+// 30-minute slots per day, guarded by its own mutex, so conflict checks are O(1).
+class AppointmentStore {
+public:
+    static const int SlotMinutes = 30;
+    static const int SlotsPerDay = 24 * 60 / SlotMinutes; // fits in one 64-bit word
+    // Bookable clinic hours: 9, 10, 11 AM and 2, 3, 4 PM
+    static constexpr uint64_t ClinicSlotMask = (1ULL << 18) | (1ULL << 20) | (1ULL << 22) |
+                                               (1ULL << 28) | (1ULL << 30) | (1ULL << 32);
+
+    enum class ReserveResult { Reserved, Conflict, Invalid };
+
+    struct FreeSlot {
+        int32_t day;
+        int slot;
+    };
+
+private:
+    struct DoctorSchedule {
+        std::mutex mutex;
+        std::unordered_map<int32_t, uint64_t> bookedSlots; // day number -> slot bitmap
+        std::vector<Appointment> appointments;
+    };
+
+    mutable std::shared_mutex schedulesMutex;
+    std::unordered_map<int, std::unique_ptr<DoctorSchedule>> schedules;
+    std::atomic<size_t> appointmentCount;
+
+    DoctorSchedule& scheduleFor(int doctorId);
+    DoctorSchedule* findSchedule(int doctorId) const;
+
+public:
+    AppointmentStore();
+
+    // Calendar helpers: days since 1970-01-01 and slot index within the day
+    static bool parseDate(std::string_view date, int32_t& day);
+    static bool parseTime(std::string_view time, int& slot);
+    static std::string formatDate(int32_t day);
+    static std::string formatSlot(int slot);
+
+    // Claims the slot before the booking is persisted; release() undoes it if the write fails.
+    // Days before today are Invalid.
+    ReserveResult reserve(int doctorId, const std::string& date, const std::string& time);
+    void release(int doctorId, const std::string& date, const std::string& time);
+    void record(const Appointment& appointment); // call once the booking is durable
+    void restore(const Appointment& appointment); // journal replay at startup
+
+    bool isBooked(int doctorId, int32_t day, int slot) const;
+    uint64_t getBookedSlots(int doctorId, int32_t day) const;
+    // Earliest open clinic slots at or after (fromDay, fromSlot), up to and including toDay
+    std::vector<FreeSlot> findFreeSlots(int doctorId, int32_t fromDay, int fromSlot, int32_t toDay, size_t limit) const;
+    static void currentDayAndSlot(int32_t& day, int& slot); // local clock
+    std::vector<Appointment> getAppointmentsForDoctor(int doctorId) const;
+    size_t size() const { return appointmentCount; }
+};
+
+// Size limits applied while parsing incoming requests
+struct HttpParserLimits {
+    size_t maxRequestLineBytes = 8192;
+    size_t maxHeaderBytes = 16384;    // all header lines (and chunked trailers) together
+    size_t maxHeaderCount = 64;
+    size_t maxBodyBytes = 1024 * 1024;
+};
+
+// Parsed HTTP request; fields are views into the request's own raw bytes
+class HttpRequest {
+private:
+    friend class HttpRequestParser;
+
+    struct Span {
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    std::string raw;
+    Span methodSpan, targetSpan, versionSpan, bodySpan;
+    std::vector<std::pair<Span, Span>> headerSpans;
+    std::chrono::steady_clock::time_point receivedAt; // when the last byte arrived
+
+    std::string_view view(Span span) const { return std::string_view(raw).substr(span.offset, span.length); }
+    // Lookups against an explicit base so the parser can use them before the bytes are moved in
+    std::string_view findHeader(std::string_view base, std::string_view name) const;
+    bool findHeaderToken(std::string_view base, std::string_view name, std::string_view token) const;
+
+public:
+    std::string_view getMethod() const { return view(methodSpan); }
+    std::string_view getTarget() const { return view(targetSpan); }
+    std::string_view getPath() const;
+    std::string_view getQuery() const;
+    std::string_view getVersion() const { return view(versionSpan); }
+    std::string_view getBody() const { return view(bodySpan); }
+    size_t getHeaderCount() const { return headerSpans.size(); }
+    std::chrono::steady_clock::time_point getReceivedAt() const { return receivedAt; }
+
+    // Case-insensitive header lookup; empty view if absent
+    std::string_view getHeader(std::string_view name) const;
+    bool hasHeaderToken(std::string_view name, std::string_view token) const;
+
+    // HTTP/1.1 defaults to persistent connections, HTTP/1.0 must opt in
+    bool wantsKeepAlive() const;
+};
+
+// application/x-www-form-urlencoded body or query string, tokenized and percent-decoded in one pass.
+// Everything decodes into a single owned buffer; fields are spans into it, so lookups never allocate.
+class FormData {
+private:
+    struct Span {
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    std::string decoded;
+    std::vector<std::pair<Span, Span>> fields; // in body order
+
+    std::string_view view(Span span) const { return std::string_view(decoded).substr(span.offset, span.length); }
+
+public:
+    FormData() = default;
+    explicit FormData(std::string_view encoded);
+
+    // Exact key match, first occurrence wins; empty view if absent
+    std::string_view get(std::string_view key) const;
+    bool has(std::string_view key) const;
+    size_t size() const { return fields.size(); }
+    void add(std::string_view key, std::string_view value); // already decoded
+
+    // Decodes '+' and %XX into out; malformed escapes are kept literally rather than rejected
+    static void decode(std::string_view encoded, std::string& out);
+    // multipart/form-data: text parts become fields, file parts are skipped
+    static bool parseMultipart(std::string_view body, std::string_view boundary, FormData& form);
+    // JSON: {...}, [{...}, ...] or {"appointments": [{...}, ...]}; each object's scalar members
+    // become one record, in document order. Deeper nesting is skipped; empty records are dropped.
+    static bool parseJson(std::string_view body, std::vector<FormData>& records, std::string& error);
+};
+
+// Incremental request parser; resumes where it stopped each time more bytes arrive.
+// Chunked bodies are de-chunked in place inside the connection buffer.
+class HttpRequestParser {
+public:
+    enum class Status { NeedMore, Complete, Error };
+
+private:
+    enum class State { RequestLine, Headers, Body, ChunkSize, ChunkData, Trailers, Done };
+
+    HttpParserLimits limits;
+    State state;
+    HttpRequest current;
+    size_t position;      // first unparsed byte
+    size_t headerBytes;
+    size_t bodyStart;
+    size_t bodyLength;    // bytes still expected (Content-Length) or decoded so far (chunked)
+    size_t chunkRemaining;
+    int errorStatus;
+    bool expectContinue;
+    bool continueSent;
+
+    Status fail(int status);
+    bool nextLine(const std::string& buffer, std::string_view& line, size_t& lineStart,
+                  size_t limit, int overflowStatus, Status& status);
+    Status beginBody(const std::string& buffer);
+
+public:
+    explicit HttpRequestParser(const HttpParserLimits& limits = HttpParserLimits());
+
+    Status parse(std::string& buffer);
+    HttpRequest takeRequest(std::string& buffer); // moves the completed request's bytes out of the buffer
+    void reset();
+
+    int getErrorStatus() const { return errorStatus; }
+    // True once headers announcing "Expect: 100-continue" are parsed and the body is still pending
+    bool needsContinue() const;
+    void markContinueSent() { continueSent = true; }
+};
+
+// Serialized response: the head (or the whole message) plus an optional shared body,
+// so cached assets go out with writev instead of being copied per request
+struct HttpResponse {
+    std::string bytes;
+    std::shared_ptr<const std::string> sharedBody;
+
+    HttpResponse() = default;
+    HttpResponse(std::string message) : bytes(std::move(message)) {}
+
+    size_t size() const { return bytes.size() + (sharedBody ? sharedBody->size() : 0); }
+    bool empty() const { return size() == 0; }
+};
+
+// One pre-encoded representation of a static asset
+struct StaticAssetVariant {
+    std::string encoding;   // "", "gzip" or "br"
+    std::string etag;
+    std::string head;       // status line and entity headers, without Connection or the blank line
+    std::shared_ptr<const std::string> body;
+
+    // If-None-Match against this representation only; another encoding's tag names different bytes
+    bool matchesEtag(std::string_view ifNoneMatch) const;
+};
+
+// Static file loaded once, with compressed variants and response headers precomputed
+struct StaticAsset {
+    std::string filePath;
+    std::string contentType;
+    std::vector<StaticAssetVariant> variants; // preference order: br, gzip, identity
+
+    const StaticAssetVariant& selectVariant(std::string_view acceptEncoding) const;
+};
+
+// inotify watcher for individual files. Directories are watched rather than the files
+// themselves so replace-by-rename (editors, atomic writers) is seen too.
+class FileWatcher {
+private:
+    struct Watch {
+        std::string directory;
+        std::string name;
+        std::function<void()> onChange;
+    };
+
+    std::vector<Watch> watches;
+    std::unordered_map<int, std::string> directories; // watch descriptor -> directory
+    int inotifyFd;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    void watchLoop();
+
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    void add(const std::string& path, std::function<void()> onChange); // before start()
+    bool start();
+    void stop();
+};
+
+// In-memory static asset cache with optional inotify-driven reload
+class StaticAssetCache {
+private:
+    struct Source {
+        std::string urlPath;
+        std::string filePath;
+        std::string contentType;
+    };
+
+    std::vector<Source> sources;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> assets;
+    FileWatcher watcher;
+
+    static std::shared_ptr<const StaticAsset> build(const std::string& filePath, const std::string& contentType);
+    bool reload(const Source& source);
+
+public:
+    // Loads the file immediately; returns false if it could not be read
+    bool add(const std::string& urlPath, const std::string& filePath, const std::string& contentType);
+    std::shared_ptr<const StaticAsset> find(const std::string& urlPath);
+
+    bool startWatching();
+    void stopWatching();
+};
+
+// Tunable server settings
+struct ServerConfig {
+    int listenBacklog = 128;   // pending connections queued by the kernel
+    int workerThreads = 8;     // handler threads (AI calls block here, not in the event loop)
+    int maxEvents = 256;       // epoll events drained per wakeup
+    int keepAliveTimeoutMs = 5000;       // idle persistent connections are closed after this
+    int maxRequestsPerConnection = 100;  // close after this many requests on one connection
+    HttpParserLimits parserLimits;
+    size_t analysisCacheCapacity = 1024;  // 0 disables the analysis cache
+    int analysisCacheTtlSeconds = 1800;
+    bool watchStaticAssets = true;   // reload index.html and the doctor roster when they change on disk
+    std::string appointmentJournalPath = "appointments.journal";
+    std::string rosterPath = "doctors.roster";     // memory-mapped doctor roster
+    std::string rosterSourcePath = "doctors.tsv";  // compiled into rosterPath if that is missing
+    std::string templateDirectory = "templates";   // *.html page fragments, compiled at startup
+    std::string geminiBaseUrl = "https://generativelanguage.googleapis.com/v1beta/models/gemini-1.5-flash-latest";
+    bool streamAnalysis = true;      // send /analyze as chunked HTML while Gemini is still generating
+    GeminiPromptOptions geminiPrompt;
+    std::string symptomRulesPath = "symptom_rules.tsv"; // keyword -> condition/specialty table
+    long geminiTimeoutMs = 30000;
+    long analyzeBudgetMs = 12000;    // /analyze answers within this; Gemini attempts get what is left
+    GeminiResilienceOptions geminiResilience;
+    std::string triageModelPath = "triage.model"; // local fallback model; optional
+    double triageFastPathProbability = 0.9;       // answer locally, skipping Gemini, at this confidence
+    long triageUpstreamTimeoutMs = 8000;          // Gemini budget once the local model can stand in
+    int availabilitySearchDays = 14;  // default window for /availability and inline slots
+    int inlineSlotCount = 3;          // free slots shown on each recommended doctor card
+    size_t maxBatchBookings = 500;    // appointments accepted by one /api/appointments/batch request
+    int shutdownDrainMs = 15000;      // in-flight requests get this long to finish after SIGTERM
+    bool reusePort = false;           // SO_REUSEPORT, so a new server can bind while this one drains
+    int inheritedListenFd = -1;       // listen socket handed over by a hot restart; used instead of binding
+    int replacesPid = 0;              // predecessor to send SIGTERM once this server is listening
+};
+
+// Fixed-size worker pool that runs request handlers off the event loop
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+
+    void workerLoop();
+
+public:
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+    // Runs queued tasks to completion (or drops them when discardQueued), then joins
+    void shutdown(bool discardQueued = false);
 };
 
 // HTTP Server with composition and abstraction
 class HttpServer {
 private:
+    // Per-client state owned by the event loop thread
+    struct Connection {
+        uint64_t id;
+        int fd;
+        std::string inBuffer;
+        HttpRequestParser parser;
+        HttpResponse out;
+        size_t outOffset = 0;
+        bool busy = false;       // a worker is producing the response
+        bool peerClosed = false;
+        bool closeAfterWrite = false;
+        int requestsServed = 0;
+        std::chrono::steady_clock::time_point lastActivity;
+
+        Connection(uint64_t id, int fd, const HttpParserLimits& limits) : id(id), fd(fd), parser(limits) {}
+    };
+
+    struct Completion {
+        uint64_t connectionId;
+        HttpResponse response;
+        bool final; // false for the leading pieces of a streamed response
+    };
+
+    // One booking, however it was submitted (urlencoded, multipart or JSON)
+    struct BookingRequest {
+        int doctorId = 0;
+        std::string patientName, patientEmail, patientPhone;
+        std::string date, time, type, notes, symptoms;
+    };
+
+    enum class BookingStatus { Booked, DoctorNotFound, Invalid, Conflict, Failed };
+
+    struct BookingResult {
+        BookingStatus status = BookingStatus::Failed;
+        int appointmentId = 0;
+        const char* invalidField = nullptr; // Invalid because of this patient field, not the date or time
+    };
+
+    // Request metrics for one route, indexed like MetricRoutes
+    struct RouteMetrics {
+        Histogram* latency;             // receipt of the last byte to the end of the response
+        std::array<Counter*, 5> status; // 1xx..5xx
+    };
+
     int port;
-    std::vector<std::shared_ptr<Doctor>> doctors; // Now owned directly
+    ServerConfig config;
+    MetricsRegistry metrics; // before everything that records into it
+    std::vector<RouteMetrics> routeMetrics;
+    Counter* acceptedConnections;
+    Gauge* openConnections;
+    Counter* parseErrors;
+    Histogram* queueWait;       // parsed request waiting for a worker
+    Histogram* bookingPersist;  // booking handler waiting for its journal commit
+    std::shared_ptr<const DoctorDirectory> directory; // swapped atomically on roster reload
+    FileWatcher rosterWatcher;
+    TemplateLibrary templates;
     std::unique_ptr<AIService> aiService;
-    bool running;
+    AnalysisCache analysisCache;
+    StaticAssetCache staticAssets;
+    std::atomic<bool> running;
+
+    // Event loop state
+    int listenFd;
+    int epollFd;
+    int wakeFd; // eventfd used by workers and stop() to interrupt epoll_wait
+    uint64_t nextConnectionId;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    std::mutex completionMutex;
+    std::vector<Completion> completions;
+    AppointmentJournal appointmentJournal;
+    AppointmentStore appointmentStore;
+    std::atomic<int> nextAppointmentId;
+    std::atomic<bool> restartRequested;
+    std::vector<std::string> restartCommand; // argv for the successor; empty disables hot restart
+    int successorPid;
+    std::unique_ptr<ThreadPool> workerPool; // declared last so workers stop before the rest is torn down
     
     // Private methods for request handling
-    std::string parseFormData(const std::string& body);
-    std::string getFormValue(const std::string& formData, const std::string& key);
-    std::string urlDecode(const std::string& encoded);
+    HttpResponse handleRequest(const HttpRequest& request, bool keepAlive);
     
     // Route handlers
-    std::string handleHomePage();
-    std::string handleAnalyzeSymptoms(const std::string& requestBody);
-    std::string handleBookAppointment(const std::string& requestBody);
-    std::string createHttpResponse(int statusCode, const std::string& body, const std::string& contentType = "text/html");
+    HttpResponse handleHomePage(const HttpRequest& request, bool keepAlive);
+    std::string handleAnalyzeSymptoms(const FormData& form, AIService::Deadline deadline);
+    void streamAnalyzeSymptoms(uint64_t connectionId, const HttpRequest& request, bool keepAlive);
+    std::string renderAnalysisTail(const SymptomAnalysis& analysis);
+    HttpResponse handleBookAppointment(const FormData& form, bool keepAlive);
+    std::string handleAvailability(const HttpRequest& request);
+
+    // JSON API: same logic as the HTML routes, JSON in and out
+    HttpResponse handleApiAnalyze(const HttpRequest& request, bool keepAlive);
+    HttpResponse handleApiDoctors(const HttpRequest& request, bool keepAlive);
+    HttpResponse handleApiBook(const HttpRequest& request, bool keepAlive, bool batch);
+    HttpResponse jsonResponse(int statusCode, const std::string& body, bool keepAlive);
+    HttpResponse jsonError(int statusCode, std::string_view message, bool keepAlive);
+
+    // Shared by the HTML and JSON routes
+    static bool readForm(const HttpRequest& request, FormData& form); // dispatches on Content-Type
+    static BookingRequest bookingFromForm(const FormData& form);
+    static const char* missingPatientField(const BookingRequest& booking); // nullptr when complete
+    static const char* bookingStatusName(BookingStatus status);
+    AnalysisCache::AnalysisPtr analyze(const FormData& form, AIService::Deadline deadline);
+    // Reserves every slot, then waits for one group commit covering the whole batch
+    std::vector<BookingResult> bookAppointments(const std::vector<BookingRequest>& requests);
+    std::vector<std::pair<std::string, std::string>> upcomingSlots(int doctorId, size_t limit) const;
+    std::string createHttpResponse(int statusCode, const std::string& body, const std::string& contentType = "text/html",
+                                   bool keepAlive = false);
+    std::string connectionHeaders(bool keepAlive) const;
+    void registerMetrics();
+    static size_t metricRoute(std::string_view method, std::string_view path);
+
+    // Event loop
+    bool openListenSocket();
+    void acceptConnections();
+    void handleReadable(Connection& conn);
+    void dispatchRequest(Connection& conn);
+    void flushWrites(Connection& conn);
+    void closeConnection(uint64_t id);
+    void closeIdleConnections();
+    void postCompletion(uint64_t connectionId, HttpResponse response, bool final = true);
+    void processCompletions();
+    void beginDrain();
+    void spawnSuccessor();
+    bool openJournal();
     
     // Doctor management
     void initializeDoctors();
+    bool loadRoster();
+    std::shared_ptr<const DoctorDirectory> currentDirectory() const;
     std::shared_ptr<Doctor> getDoctorById(int id) const;
     std::vector<std::shared_ptr<Doctor>> getDoctorsBySpecialty(const std::string& specialty) const;
 
-    // Appointment file writing
-    void writeAppointmentToFile(const std::string& details);
-
 public:
-    HttpServer(int port, const std::string& geminiApiKey);
+    HttpServer(int port, const std::string& geminiApiKey, const ServerConfig& config = ServerConfig());
     virtual ~HttpServer();
+
+    // Stateless, and public so bench.cpp can time it; forms go through FormData
+    static std::string urlDecode(const std::string& encoded);
     
-    // Server lifecycle management
+    // Server lifecycle management. start() binds (or adopts) the listen socket and opens the journal;
+    // stop() and requestRestart() only set flags and write an eventfd, so signal handlers may call them.
     bool start();
-    void stop();
+    void stop(); // run() then drains: no new connections, in-flight requests finish, journal flushed
+    void requestRestart(); // hand the listen socket to a fresh copy of restartCommand, then drain
+    void setRestartCommand(std::vector<std::string> argv) { restartCommand = std::move(argv); }
     bool isRunning() const { return running; }
     
     // Main server loop
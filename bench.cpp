@@ -0,0 +1,697 @@
+// MediCare benchmark driver: microbenchmarks, a mock Gemini server and an HTTP load generator.
+//
+//   medicare_bench micro [--filter text]
+//   medicare_bench mock-gemini [--port 19099] [--latency-ms 50] [--bytes 2048] [--chunks 4]
+//   medicare_bench load [--port 8080] [--mode closed|open] [--connections 16] [--rate 500]
+//                       [--seconds 5] [--mix get=70,analyze=20,book=10] [--unique-analyze]
+//   medicare_bench suite [same options]   (what `make bench` runs)
+//
+// Nothing here talks to the real Gemini API: the suite starts the mock in-process and points
+// the server at it through MEDICARE_GEMINI_URL.
+#include "MediCareServer.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cstring>
+#include <cstdio>
+#include <random>
+
+using namespace MediCare;
+using Clock = std::chrono::steady_clock;
+
+// Command line: "--key value" pairs and bare "--flag"s
+struct Options {
+    std::map<std::string, std::string> values;
+
+    Options(int argc, char* argv[], int first) {
+        for (int i = first; i < argc; ++i) {
+            std::string key = argv[i];
+            if (key.compare(0, 2, "--") != 0) continue;
+            bool hasValue = i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0;
+            values[key.substr(2)] = hasValue ? argv[++i] : "1";
+        }
+    }
+    std::string get(const std::string& key, const std::string& fallback) const {
+        auto it = values.find(key);
+        return it == values.end() ? fallback : it->second;
+    }
+    double number(const std::string& key, double fallback) const {
+        auto it = values.find(key);
+        return it == values.end() ? fallback : std::atof(it->second.c_str());
+    }
+    bool flag(const std::string& key) const { return values.count(key) > 0; }
+};
+
+// Keeps the optimizer from discarding a benchmarked result
+template <typename T>
+static void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// ---------------------------------------------------------------------------
+// Microbenchmarks
+// ---------------------------------------------------------------------------
+
+struct MicroBenchmark {
+    std::string name;
+    std::function<void()> body;
+};
+
+// Grows the iteration count until a run takes at least a quarter second, then reports per-op time
+static void runMicroBenchmark(const MicroBenchmark& benchmark) {
+    for (int i = 0; i < 100; ++i) benchmark.body(); // warm caches and lazily built state
+    uint64_t iterations = 1;
+    for (;;) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) benchmark.body();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= 0.25 || iterations >= (uint64_t(1) << 32)) {
+            printf("%-44s %12.1f ns %14llu\n", benchmark.name.c_str(), seconds * 1e9 / iterations,
+                   static_cast<unsigned long long>(iterations));
+            return;
+        }
+        double scale = seconds > 0 ? 0.3 / seconds : 100;
+        iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 100.0)));
+    }
+}
+
+static std::vector<std::shared_ptr<Doctor>> syntheticDoctors(size_t count) {
+    static const char* const specialties[] = {"Cardiology", "Family Medicine", "Internal Medicine", "Neurology",
+                                              "Pulmonology", "Dermatology", "Orthopedics", "Pediatrics"};
+    std::vector<std::shared_ptr<Doctor>> doctors;
+    for (size_t i = 0; i < count; ++i) {
+        const char* specialty = specialties[i % std::size(specialties)];
+        doctors.push_back(std::make_shared<Doctor>(
+            static_cast<int>(i + 1), "Dr. Bench " + std::to_string(i), specialty, 5 + static_cast<int>(i % 20),
+            3.5 + (i % 15) / 10.0, 10 + static_cast<int>(i * 7 % 500), "Synthetic doctor for benchmarks.",
+            100 + static_cast<int>(i % 10) * 25, "", std::vector<std::string>{specialty, "General Consultation"}));
+    }
+    return doctors;
+}
+
+static int runMicro(const Options& options) {
+    TemplateLibrary templates;
+    std::string error;
+    templates.load("templates", error);
+    if (!error.empty()) {
+        std::cerr << "Template problems (run from the repository root): " << error << std::endl;
+    }
+
+    SymptomAnalysis analysis("persistent dry cough, mild fever and a headache", "3 days", 5);
+    analysis.addCondition("Respiratory Infection", "Possible viral or bacterial respiratory infection", 75);
+    analysis.addCondition("Viral Infection", "Common viral illness with fever symptoms", 85);
+    analysis.addCondition("Tension Headache", "Common type of headache caused by stress or muscle tension", 80);
+    analysis.addCondition("General Medical Assessment", "Symptoms require professional medical evaluation", 60);
+    for (const char* text : {"Consult with a healthcare professional for proper diagnosis",
+                             "Monitor symptoms closely and note any changes", "Rest and stay hydrated",
+                             "Take over-the-counter medication if needed for symptom relief"}) {
+        analysis.addRecommendation(text);
+    }
+    for (const char* text : {"Difficulty breathing or shortness of breath", "Severe or worsening pain",
+                             "High fever above 102°F", "Loss of consciousness or confusion"}) {
+        analysis.addWarningSign(text);
+    }
+    std::string markdown;
+    while (markdown.size() < 2048) {
+        markdown += "## Assessment\nSymptoms like **cough** and *fever* suggest a `viral` infection.\n"
+                    "* Rest & fluids\n* Paracetamol <if needed>\n\n";
+    }
+    analysis.setMainAIText(markdown);
+    analysis.setRawAIResponse(std::string(4096, 'x'));
+
+    const std::string bookingForm =
+        "doctor_id=3&patient_name=Jane+Q.+Public&patient_email=jane%40example.com&patient_phone=%2B1+555+0100"
+        "&appointment_date=2026-11-02&appointment_time=10%3A00+AM&appointment_type=in-person"
+        "&notes=Second+visit%2C+bring+previous+test+results&symptoms=dry+cough%2C+mild+fever";
+    std::string encoded;
+    while (encoded.size() < 200) encoded += "chest+pain+%26+shortness+of+breath%2C+";
+
+    SpecialtyIndex smallIndex;
+    auto smallDoctors = syntheticDoctors(10);
+    smallIndex.build(smallDoctors);
+    SpecialtyIndex largeIndex;
+    auto largeDoctors = syntheticDoctors(1000);
+    largeIndex.build(largeDoctors);
+    const std::vector<std::string> suggested = {"Pulmonology", "Internal Medicine", "Family Medicine"};
+
+    std::vector<MicroBenchmark> benchmarks = {
+        {"SymptomAnalysis::renderHtmlResults", [&]() {
+            std::string out;
+            analysis.renderHtmlResults(templates, out);
+            doNotOptimize(out);
+        }},
+        {"SymptomAnalysis::renderHtmlResults/noText", [&]() {
+            std::string out;
+            analysis.renderHtmlResults(templates, out, false);
+            doNotOptimize(out);
+        }},
+        {"FormData/bookingForm", [&]() {
+            FormData form(bookingForm);
+            for (const char* key : {"doctor_id", "patient_name", "patient_email", "patient_phone", "appointment_date",
+                                    "appointment_time", "appointment_type", "notes", "symptoms"}) {
+                doNotOptimize(form.get(key));
+            }
+        }},
+        {"HttpServer::urlDecode/200B", [&]() {
+            doNotOptimize(HttpServer::urlDecode(encoded));
+        }},
+        {"SpecialtyIndex::lookup/10", [&]() {
+            doNotOptimize(smallIndex.lookup("pulmonology"));
+        }},
+        {"SpecialtyIndex::lookup/1000", [&]() {
+            doNotOptimize(largeIndex.lookup("pulmonology"));
+        }},
+        {"SpecialtyIndex::lookupAny/1000", [&]() {
+            doNotOptimize(largeIndex.lookupAny(suggested, 3));
+        }},
+    };
+
+    std::string filter = options.get("filter", "");
+    printf("%-44s %15s %14s\n", "Benchmark", "Time", "Iterations");
+    printf("%s\n", std::string(75, '-').c_str());
+    for (const MicroBenchmark& benchmark : benchmarks) {
+        if (filter.empty() || benchmark.name.find(filter) != std::string::npos) runMicroBenchmark(benchmark);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Socket helpers
+// ---------------------------------------------------------------------------
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+static int listenOn(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 512) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connectTo(const std::string& host, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &address.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Buffered reader for one HTTP/1.1 message at a time on a keep-alive socket
+class HttpReader {
+private:
+    int fd;
+    std::string buffer;
+
+    bool fill() {
+        char chunk[16384];
+        ssize_t n;
+        do {
+            n = recv(fd, chunk, sizeof(chunk), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+    bool readLine(std::string& line) {
+        size_t end;
+        while ((end = buffer.find("\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        line.assign(buffer, 0, end);
+        buffer.erase(0, end + 2);
+        return true;
+    }
+    bool readBytes(size_t count, std::string* into) {
+        while (buffer.size() < count) {
+            if (!fill()) return false;
+        }
+        if (into) into->append(buffer, 0, count);
+        buffer.erase(0, count);
+        return true;
+    }
+
+public:
+    explicit HttpReader(int fd) : fd(fd) {}
+
+    struct Message {
+        int status = 0;               // response status; 0 for requests
+        std::string method, target;   // requests only
+        std::map<std::string, std::string> headers; // lower-case names
+        std::string body;
+    };
+
+    // Reads a request or response, de-chunking the body; false on EOF or a malformed message
+    bool read(Message& message, bool isResponse) {
+        std::string line;
+        if (!readLine(line)) return false;
+        if (isResponse) {
+            if (line.size() < 12) return false;
+            message.status = std::atoi(line.c_str() + 9);
+        } else {
+            size_t space = line.find(' ');
+            size_t second = line.find(' ', space + 1);
+            if (space == std::string::npos || second == std::string::npos) return false;
+            message.method = line.substr(0, space);
+            message.target = line.substr(space + 1, second - space - 1);
+        }
+        while (readLine(line) && !line.empty()) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = line.substr(0, colon);
+            for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            size_t value = line.find_first_not_of(' ', colon + 1);
+            message.headers[name] = value == std::string::npos ? "" : line.substr(value);
+        }
+
+        auto encoding = message.headers.find("transfer-encoding");
+        if (encoding != message.headers.end() && encoding->second.find("chunked") != std::string::npos) {
+            for (;;) {
+                if (!readLine(line)) return false;
+                size_t size = std::strtoul(line.c_str(), nullptr, 16);
+                if (size == 0) return readLine(line); // no trailers are ever sent
+                if (!readBytes(size, &message.body) || !readBytes(2, nullptr)) return false;
+            }
+        }
+        auto length = message.headers.find("content-length");
+        size_t size = length == message.headers.end() ? 0 : std::strtoul(length->second.c_str(), nullptr, 10);
+        return readBytes(size, &message.body);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Mock Gemini server
+// ---------------------------------------------------------------------------
+
+struct MockGeminiOptions {
+    int port = 19099;
+    long latencyMs = 50;   // total generation time; streamed replies spread it over the chunks
+    size_t bytes = 2048;   // answer text length
+    int chunks = 4;        // parts in a streamGenerateContent reply
+};
+
+static std::string mockAnswerText(size_t bytes) {
+    static const std::string paragraph =
+        "## Assessment\\nThe symptoms are most consistent with a **viral respiratory infection**.\\n"
+        "* Rest and drink plenty of fluids\\n* Paracetamol can ease fever and aches\\n\\n"
+        "See a doctor if breathing becomes difficult or the fever lasts more than three days.\\n\\n";
+    std::string text;
+    while (text.size() < bytes) text += paragraph;
+    text.resize(bytes);
+    while (!text.empty() && text.back() == '\\') text.pop_back(); // never cut an escape in half
+    return text;
+}
+
+static std::string mockCandidate(const std::string& text, int outputTokens) {
+    return "{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"" + text +
+           "\"}],\"role\":\"model\"},\"finishReason\":\"STOP\"}],\"usageMetadata\":{\"promptTokenCount\":120,"
+           "\"candidatesTokenCount\":" + std::to_string(outputTokens) + "}}";
+}
+
+static void serveMockConnection(int fd, const MockGeminiOptions& options) {
+    HttpReader reader(fd);
+    const std::string text = mockAnswerText(options.bytes);
+    HttpReader::Message request;
+    while (reader.read(request, false)) {
+        bool stream = request.target.find(":streamGenerateContent") != std::string::npos;
+        if (!stream) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.latencyMs));
+            std::string body = mockCandidate(text, static_cast<int>(text.size() / 4));
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                                   std::to_string(body.size()) + "\r\n\r\n" + body;
+            if (!sendAll(fd, response)) break;
+        } else {
+            if (!sendAll(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n")) break;
+            int parts = std::max(1, options.chunks);
+            size_t partSize = (text.size() + parts - 1) / parts;
+            bool ok = true;
+            for (int i = 0; ok && i < parts; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(options.latencyMs / parts));
+                std::string piece = text.substr(std::min(text.size(), i * partSize), partSize);
+                while (!piece.empty() && piece.back() == '\\') piece.pop_back();
+                std::string element = (i == 0 ? "[" : ",\r\n") + mockCandidate(piece, static_cast<int>((i + 1) * partSize / 4));
+                char size[20];
+                snprintf(size, sizeof(size), "%zx\r\n", element.size());
+                ok = sendAll(fd, size + element + "\r\n");
+            }
+            if (!ok || !sendAll(fd, "1\r\n]\r\n0\r\n\r\n")) break;
+        }
+        request = HttpReader::Message();
+    }
+    close(fd);
+}
+
+// Accepts on its own thread; each connection gets a thread, like a slow upstream would behave
+static bool startMockGemini(const MockGeminiOptions& options) {
+    int listenFd = listenOn(options.port);
+    if (listenFd < 0) {
+        std::cerr << "Mock Gemini: cannot listen on port " << options.port << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    std::thread([listenFd, options]() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+            std::thread(serveMockConnection, fd, options).detach();
+        }
+    }).detach();
+    return true;
+}
+
+static MockGeminiOptions mockOptionsFrom(const Options& options) {
+    MockGeminiOptions mock;
+    mock.port = static_cast<int>(options.number("mock-port", options.number("port", mock.port)));
+    mock.latencyMs = static_cast<long>(options.number("latency-ms", mock.latencyMs));
+    mock.bytes = static_cast<size_t>(options.number("bytes", mock.bytes));
+    mock.chunks = static_cast<int>(options.number("chunks", mock.chunks));
+    return mock;
+}
+
+// ---------------------------------------------------------------------------
+// Load generator
+// ---------------------------------------------------------------------------
+
+enum Route { RouteHome, RouteAnalyze, RouteBook, RouteCount };
+static const char* const RouteNames[RouteCount] = {"GET /", "POST /analyze", "POST /book"};
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    bool openLoop = false;     // open: fixed arrival rate, latency counted from the scheduled send time
+    int connections = 16;
+    double rate = 500;         // open loop only, requests per second across all connections
+    double seconds = 5;
+    int weights[RouteCount] = {70, 20, 10};
+    bool uniqueAnalyze = false; // defeat the analysis cache so every /analyze reaches the upstream
+};
+
+struct RouteStats {
+    Histogram latency;
+    std::atomic<uint64_t> errors{0};
+};
+
+static std::string urlEncode(const std::string& text) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else if (c == ' ') {
+            out += '+';
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+static std::string buildRequest(Route route, const LoadOptions& options, std::mt19937& random, uint64_t sequence) {
+    static const char* const symptoms[] = {
+        "dry cough and mild fever", "headache and stress at work", "chest pain when climbing stairs",
+        "nausea and stomach cramps", "sore throat, runny nose and chills", "itchy rash on both arms",
+        "lower back pain after lifting", "dizziness and fatigue in the mornings"};
+    static const char* const times[] = {"9:00 AM", "10:00 AM", "11:00 AM", "2:00 PM", "3:00 PM", "4:00 PM"};
+    std::string host = "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n";
+
+    if (route == RouteHome) {
+        return "GET / HTTP/1.1\r\n" + host + "Accept-Encoding: br, gzip\r\n\r\n";
+    }
+    std::string body;
+    if (route == RouteAnalyze) {
+        std::string text = symptoms[random() % std::size(symptoms)];
+        if (options.uniqueAnalyze) text += " (case " + std::to_string(sequence) + ")";
+        body = "symptoms=" + urlEncode(text) + "&duration=" + std::to_string(1 + random() % 7) +
+               "+days&severity=" + std::to_string(1 + random() % 10);
+    } else {
+        // Dates far in the future and spread widely, so bookings rarely collide
+        int32_t day = 0;
+        AppointmentStore::parseDate("2030-01-01", day);
+        body = "doctor_id=" + std::to_string(1 + random() % 10) + "&patient_name=Load+Test&patient_email=" +
+               urlEncode("load@example.com") + "&patient_phone=555-0100&appointment_date=" +
+               AppointmentStore::formatDate(day + static_cast<int32_t>(random() % 3650)) + "&appointment_time=" +
+               urlEncode(times[random() % std::size(times)]) + "&appointment_type=in-person&notes=&symptoms=";
+    }
+    const char* path = route == RouteAnalyze ? "/analyze" : "/book";
+    return std::string("POST ") + path + " HTTP/1.1\r\n" + host +
+           "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " + std::to_string(body.size()) +
+           "\r\n\r\n" + body;
+}
+
+static void loadWorker(const LoadOptions& options, int index, Clock::time_point start, Clock::time_point end,
+                       std::array<RouteStats, RouteCount>& stats, std::atomic<uint64_t>& sequence) {
+    std::mt19937 random(static_cast<unsigned>(index * 7919 + 17));
+    int totalWeight = 0;
+    for (int weight : options.weights) totalWeight += weight;
+    // Open loop: this connection owns every connections-th arrival of the global schedule
+    double interval = options.openLoop ? options.connections / options.rate : 0;
+    Clock::time_point scheduled = start + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double>(interval * index / options.connections));
+
+    int fd = -1;
+    std::unique_ptr<HttpReader> reader;
+    for (;;) {
+        if (options.openLoop) {
+            if (scheduled >= end) break;
+            std::this_thread::sleep_until(scheduled);
+        } else if (Clock::now() >= end) {
+            break;
+        }
+
+        int pick = static_cast<int>(random() % totalWeight);
+        int route = RouteHome;
+        while (pick >= options.weights[route]) pick -= options.weights[route++];
+
+        Clock::time_point sentAt = options.openLoop ? scheduled : Clock::now();
+        if (options.openLoop) {
+            scheduled += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+        }
+        if (fd < 0) {
+            fd = connectTo(options.host, options.port);
+            if (fd < 0) {
+                stats[route].errors++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            reader = std::make_unique<HttpReader>(fd);
+        }
+
+        HttpReader::Message response;
+        bool ok = sendAll(fd, buildRequest(static_cast<Route>(route), options, random, sequence++)) && reader->read(response, true);
+        stats[route].latency.recordDuration(Clock::now() - sentAt);
+        if (!ok || response.status != 200) stats[route].errors++;
+        auto connection = response.headers.find("connection");
+        if (!ok || (connection != response.headers.end() && connection->second == "close")) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+}
+
+static bool parseMix(const std::string& mix, int weights[RouteCount]) {
+    static const char* const keys[RouteCount] = {"get", "analyze", "book"};
+    std::fill(weights, weights + RouteCount, 0);
+    std::stringstream stream(mix);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) return false;
+        std::string key = item.substr(0, equals);
+        int route = static_cast<int>(std::find(keys, keys + RouteCount, key) - keys);
+        if (route == RouteCount) return false;
+        weights[route] = std::atoi(item.c_str() + equals + 1);
+    }
+    return weights[RouteHome] + weights[RouteAnalyze] + weights[RouteBook] > 0;
+}
+
+static double millis(uint64_t micros) {
+    return micros / 1000.0;
+}
+
+static int runLoad(const LoadOptions& options) {
+    std::array<RouteStats, RouteCount> stats;
+    std::atomic<uint64_t> sequence{static_cast<uint64_t>(time(nullptr)) * 1000};
+    auto start = Clock::now() + std::chrono::milliseconds(50);
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.connections; ++i) {
+        workers.emplace_back(loadWorker, std::cref(options), i, start, end, std::ref(stats), std::ref(sequence));
+    }
+    for (auto& worker : workers) worker.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t total = 0;
+    uint64_t errors = 0;
+    for (const RouteStats& route : stats) {
+        total += route.latency.snapshot().count;
+        errors += route.errors;
+    }
+    printf("\n%s loop, %d connections", options.openLoop ? "Open" : "Closed", options.connections);
+    if (options.openLoop) printf(", target %.0f req/s", options.rate);
+    printf(", %.1f s: %llu requests, %.1f req/s, %llu errors\n", elapsed, static_cast<unsigned long long>(total),
+           total / elapsed, static_cast<unsigned long long>(errors));
+    printf("%-15s %9s %7s %9s %9s %9s %9s %9s %9s\n", "route", "requests", "errors", "req/s", "p50 ms", "p90 ms",
+           "p99 ms", "p99.9 ms", "max ms");
+    for (int route = 0; route < RouteCount; ++route) {
+        Histogram::Snapshot snapshot = stats[route].latency.snapshot();
+        if (snapshot.count == 0) continue;
+        printf("%-15s %9llu %7llu %9.1f %9.2f %9.2f %9.2f %9.2f %9.2f\n", RouteNames[route],
+               static_cast<unsigned long long>(snapshot.count), static_cast<unsigned long long>(stats[route].errors.load()),
+               snapshot.count / elapsed, millis(snapshot.quantile(0.5)), millis(snapshot.quantile(0.9)),
+               millis(snapshot.quantile(0.99)), millis(snapshot.quantile(0.999)), millis(snapshot.quantile(1.0)));
+    }
+    return errors == 0 ? 0 : 2;
+}
+
+static bool loadOptionsFrom(const Options& options, LoadOptions& load) {
+    load.host = options.get("host", load.host);
+    load.port = static_cast<int>(options.number("port", load.port));
+    load.openLoop = options.get("mode", "closed") == "open";
+    load.connections = std::max(1, static_cast<int>(options.number("connections", load.connections)));
+    load.rate = std::max(1.0, options.number("rate", load.rate));
+    load.seconds = std::max(0.1, options.number("seconds", load.seconds));
+    load.uniqueAnalyze = options.flag("unique-analyze");
+    if (options.flag("mix") && !parseMix(options.get("mix", ""), load.weights)) {
+        std::cerr << "Bad --mix; expected e.g. get=70,analyze=20,book=10" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Suite: micro, then the real server against the mock under closed and open loop load
+// ---------------------------------------------------------------------------
+
+static bool waitForPort(int port, std::chrono::seconds limit) {
+    auto until = Clock::now() + limit;
+    while (Clock::now() < until) {
+        int fd = connectTo("127.0.0.1", port);
+        if (fd >= 0) {
+            close(fd);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+static int runSuite(const Options& options) {
+    printf("== Microbenchmarks ==\n");
+    runMicro(options);
+
+    MockGeminiOptions mock = mockOptionsFrom(Options(0, nullptr, 0));
+    mock.port = static_cast<int>(options.number("mock-port", mock.port));
+    mock.latencyMs = static_cast<long>(options.number("latency-ms", mock.latencyMs));
+    mock.bytes = static_cast<size_t>(options.number("bytes", mock.bytes));
+    mock.chunks = static_cast<int>(options.number("chunks", mock.chunks));
+    if (!startMockGemini(mock)) return 1;
+
+    int serverPort = static_cast<int>(options.number("port", 18080));
+    std::string journal = "/tmp/medicare_bench_" + std::to_string(getpid()) + ".journal";
+    std::string log = "/tmp/medicare_bench_server.log";
+    fflush(stdout); // otherwise the child flushes our buffered output a second time
+    pid_t server = fork();
+    if (server == 0) {
+        setenv("MEDICARE_PORT", std::to_string(serverPort).c_str(), 1);
+        setenv("MEDICARE_GEMINI_URL", ("http://127.0.0.1:" + std::to_string(mock.port) + "/v1beta/models/mock").c_str(), 1);
+        setenv("MEDICARE_JOURNAL", journal.c_str(), 1);
+        FILE* output = freopen(log.c_str(), "w", stdout);
+        (void)output;
+        dup2(STDOUT_FILENO, STDERR_FILENO);
+        std::string binary = options.get("server", "./medicare_server");
+        execl(binary.c_str(), binary.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    if (server < 0 || !waitForPort(serverPort, std::chrono::seconds(10))) {
+        std::cerr << "Server did not come up on port " << serverPort << "; see " << log << std::endl;
+        if (server > 0) kill(server, SIGKILL);
+        return 1;
+    }
+    printf("\n== Load (server on :%d, mock Gemini on :%d, %ld ms latency, %zu byte answers) ==\n", serverPort,
+           mock.port, mock.latencyMs, mock.bytes);
+
+    LoadOptions load;
+    load.port = serverPort;
+    load.uniqueAnalyze = true;
+    load.connections = 32;
+    Options overrides = options;
+    overrides.values.erase("port"); // the suite's --port is the server's
+    int status = loadOptionsFrom(overrides, load) ? 0 : 1;
+    load.port = serverPort;
+    load.uniqueAnalyze = true;
+    if (status == 0) {
+        load.openLoop = false;
+        status = std::max(status, runLoad(load));
+        load.openLoop = true;
+        status = std::max(status, runLoad(load));
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    unlink(journal.c_str());
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    Options options(argc, argv, 2);
+
+    if (command == "micro") return runMicro(options);
+    if (command == "suite") return runSuite(options);
+    if (command == "mock-gemini") {
+        MockGeminiOptions mock = mockOptionsFrom(options);
+        if (!startMockGemini(mock)) return 1;
+        std::cout << "Mock Gemini listening on 127.0.0.1:" << mock.port << " (" << mock.latencyMs << " ms, "
+                  << mock.bytes << " bytes, " << mock.chunks << " chunks); Ctrl+C to stop" << std::endl;
+        for (;;) pause();
+    }
+    if (command == "load") {
+        LoadOptions load;
+        if (!loadOptionsFrom(options, load)) return 1;
+        return runLoad(load);
+    }
+
+    std::cerr << "usage: " << argv[0] << " micro|mock-gemini|load|suite [options]\n"
+              << "  micro        [--filter text]\n"
+              << "  mock-gemini  [--port 19099] [--latency-ms 50] [--bytes 2048] [--chunks 4]\n"
+              << "  load         [--port 8080] [--mode closed|open] [--connections 16] [--rate 500] [--seconds 5]\n"
+              << "               [--mix get=70,analyze=20,book=10] [--unique-analyze]\n"
+              << "  suite        load options plus [--mock-port 19099] [--latency-ms] [--bytes] [--chunks]\n"
+              << "               [--server ./medicare_server]; --port is the server's (default 18080)" << std::endl;
+    return 1;
+}
@@ -1,22 +1,54 @@
 #include "MediCareServer.h"
 #include <iostream>
 #include <cstdlib>
+#include <climits>
 #include <signal.h>
+#include <unistd.h>
 
 using namespace MediCare;
 
+// Read an integer setting from the environment, falling back to a default
+static int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) return fallback;
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+// Read a string setting from the environment, falling back to a default
+static std::string envString(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return value && *value ? value : fallback;
+}
+
 // Global server instance for signal handling
 std::unique_ptr<HttpServer> globalServer;
 
+// Only async-signal-safe work here: the server drains from its own loop once woken.
+// SIGUSR2 hands the listen socket to a freshly started copy (zero-downtime deploy);
+// a second SIGINT/SIGTERM skips the drain.
 void signalHandler(int signal) {
-    if (globalServer) {
-        std::cout << "\nShutting down MediCare AI server gracefully..." << std::endl;
-        globalServer->stop();
+    static volatile sig_atomic_t stopRequests = 0;
+    if (signal == SIGUSR2) {
+        if (globalServer) globalServer->requestRestart();
+        return;
     }
-    exit(0);
+    if (++stopRequests > 1) _exit(1);
+    if (globalServer) globalServer->stop();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Offline mode: compile the tab-separated roster into the mapped binary format
+    if (argc == 4 && std::string(argv[1]) == "--build-roster") {
+        std::string error;
+        if (!DoctorRoster::compile(argv[2], argv[3], error)) {
+            std::cerr << "❌ " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << argv[3] << std::endl;
+        return 0;
+    }
+
     std::cout << "=== MediCare AI - Pure C++ Backend System ===" << std::endl;
     std::cout << "Intelligent Clinic with Strict Language Compliance" << std::endl;
     std::cout << "=============================================" << std::endl;
@@ -27,7 +59,26 @@ int main() {
     
     //API and pOrt intialliazation 
     
-    int port = 8080;
+    int port = envInt("MEDICARE_PORT", 8080);
+    
+    // Concurrency settings (override with MEDICARE_WORKERS / MEDICARE_BACKLOG)
+    ServerConfig config;
+    config.workerThreads = envInt("MEDICARE_WORKERS", static_cast<int>(std::max(4u, std::thread::hardware_concurrency() * 2)));
+    config.listenBacklog = envInt("MEDICARE_BACKLOG", config.listenBacklog);
+    // MEDICARE_GEMINI_URL points the AI client elsewhere (e.g. a local mock); MEDICARE_STREAM=0 disables streaming
+    config.geminiBaseUrl = envString("MEDICARE_GEMINI_URL", config.geminiBaseUrl);
+    config.streamAnalysis = envString("MEDICARE_STREAM", "1") != "0";
+    // MEDICARE_JOURNAL moves the appointment journal (the bench suite books into a scratch file)
+    config.appointmentJournalPath = envString("MEDICARE_JOURNAL", config.appointmentJournalPath);
+    // MEDICARE_ANALYZE_BUDGET_MS bounds /analyze latency; MEDICARE_HEDGE=1 races a duplicate Gemini call past the p95
+    config.analyzeBudgetMs = envInt("MEDICARE_ANALYZE_BUDGET_MS", static_cast<int>(config.analyzeBudgetMs));
+    config.geminiResilience.hedgeRequests = envString("MEDICARE_HEDGE", "0") == "1";
+    // Restarts: MEDICARE_REUSEPORT=1 lets the next version bind alongside this one; MEDICARE_LISTEN_FD and
+    // MEDICARE_REPLACES_PID are set by the SIGUSR2 hot restart; MEDICARE_DRAIN_MS bounds the shutdown drain
+    config.reusePort = envString("MEDICARE_REUSEPORT", "0") == "1";
+    config.inheritedListenFd = envInt("MEDICARE_LISTEN_FD", -1);
+    config.replacesPid = envInt("MEDICARE_REPLACES_PID", 0);
+    config.shutdownDrainMs = envInt("MEDICARE_DRAIN_MS", config.shutdownDrainMs);
     
     // Use the configured Gemini API key
     std::string apiKey = "YOUR_API_KEY";
@@ -43,20 +94,41 @@ int main() {
     std::cout << "\n🔧 Configuration:" << std::endl;
     std::cout << "   • Server Port: " << port << std::endl;
     std::cout << "   • Gemini AI: ✅ Configured" << std::endl;
+    std::cout << "   • Worker Threads: " << config.workerThreads << std::endl;
+    std::cout << "   • Listen Backlog: " << config.listenBacklog << std::endl;
+    std::cout << "   • Streaming Analysis: " << (config.streamAnalysis ? "on" : "off") << std::endl;
+    std::cout << "   • Analysis Budget: " << config.analyzeBudgetMs << " ms"
+              << (config.geminiResilience.hedgeRequests ? " (hedged Gemini calls)" : "") << std::endl;
     std::cout << "   • File Structure: ✅ Minimized (3 files total)" << std::endl;
     std::cout << "\n📁 Architecture Components:" << std::endl;
     std::cout << "   ├── index.html (Pure HTML/CSS Frontend)" << std::endl;
+    std::cout << "   ├── templates/ (HTML page fragments, compiled at startup)" << std::endl;
+    std::cout << "   ├── doctors.tsv (Doctor roster, mapped as " << config.rosterPath << ")" << std::endl;
+    std::cout << "   ├── " << config.symptomRulesPath << " (Symptom keyword rules)" << std::endl;
+    std::cout << "   ├── " << config.triageModelPath << " (Offline triage model)" << std::endl;
     std::cout << "   ├── MediCareServer.h (C++ Class Definitions)" << std::endl;
     std::cout << "   ├── MediCareServer.cpp (Complete Implementation)" << std::endl;
     std::cout << "   └── main.cpp (Server Entry Point)" << std::endl;
     
     try {
         // Create C++ server with strict OOP compliance
-        globalServer = std::make_unique<HttpServer>(port, apiKey);
+        globalServer = std::make_unique<HttpServer>(port, apiKey, config);
         
-        // Set up signal handling for graceful shutdown
+        // Set up signal handling for graceful shutdown and hot restart
         signal(SIGINT, signalHandler);
         signal(SIGTERM, signalHandler);
+        signal(SIGUSR2, signalHandler);
+
+        // The successor is started from the same path (a deploy replaces the file, or a symlink, in place)
+        std::vector<std::string> restartCommand(argv, argv + argc);
+        char cwd[PATH_MAX];
+        if (!restartCommand.empty() && restartCommand[0].find('/') != std::string::npos &&
+            restartCommand[0][0] != '/' && getcwd(cwd, sizeof(cwd))) {
+            restartCommand[0] = std::string(cwd) + "/" + restartCommand[0];
+        }
+        if (!restartCommand.empty() && restartCommand[0].find('/') != std::string::npos) {
+            globalServer->setRestartCommand(restartCommand);
+        }
         
         std::cout << "\n🚀 Starting MediCare AI C++ Server..." << std::endl;
         
@@ -76,7 +148,12 @@ int main() {
         std::cout << "   GET  / - Main symptom input page" << std::endl;
         std::cout << "   POST /analyze - AI symptom analysis" << std::endl;
         std::cout << "   POST /book - Doctor appointment booking" << std::endl;
+        std::cout << "   GET  /availability - Next free slots by doctor_id or specialty" << std::endl;
         std::cout << "   POST /confirm-booking - Appointment confirmation" << std::endl;
+        std::cout << "   GET  /metrics - Prometheus metrics (per-route latency, Gemini, journal)" << std::endl;
+        std::cout << "   POST /api/analyze - Symptom analysis as JSON" << std::endl;
+        std::cout << "   GET  /api/doctors - Doctor listing as JSON (?specialty=, ?slots=)" << std::endl;
+        std::cout << "   POST /api/appointments[/batch] - Book one or many appointments (JSON, form or multipart)" << std::endl;
         
         std::cout << "\n✨ Medical Features:" << std::endl;
         std::cout << "   🧠 Gemini AI-powered symptom analysis" << std::endl;
@@ -85,10 +162,12 @@ int main() {
         std::cout << "   🚨 Emergency contact integration" << std::endl;
         
         std::cout << "\n💻 Access your clinic at: http://localhost:" << port << std::endl;
-        std::cout << "🛑 Press Ctrl+C to stop the server..." << std::endl;
+        std::cout << "🛑 Press Ctrl+C to stop the server (in-flight requests finish first)..." << std::endl;
+        std::cout << "🔄 Zero-downtime restart: kill -USR2 " << getpid() << std::endl;
         
-        // Run the main server loop
+        // Run the main server loop; returns once a stop request has been drained
         globalServer->run();
+        globalServer.reset(); // joins the workers and closes the journal before we report success
         
     } catch (const std::exception& e) {
         std::cerr << "❌ Server exception: " << e.what() << std::endl;